@@ -19,9 +19,16 @@ typedef struct
     float vx, vy, vz;
 } rigidbody_t;
 
+typedef struct
+{
+    float dt;
+} game_time_t;
+
 ecs_err_t physics_system(ecs_entity_t *it, int count, void *args[])
 {
-    float dt = *(float *)args[0];
+    game_time_t *time;
+    ecs_get_resource(game_time_t, &time);
+    float dt = time->dt;
 
     for (int i = 0; i < count; ++i)
     {
@@ -50,11 +57,14 @@ int main(void)
 
     ecs_register_component(transform_t);
     ecs_register_component(rigidbody_t);
+    ecs_register_component(game_time_t);
 
     // Register physic system
-    ecs_signature_t signature;
+    ecs_signature_t signature, resources;
     ecs_create_signature(&signature, transform_t, rigidbody_t);
+    ecs_create_signature(&resources, game_time_t);
     ret |= ecs_register_system(physics_system, signature, ECS_SYSTEM_ON_UPDATE);
+    ret |= ecs_set_system_resources(physics_system, resources, 0);
     ECS_CHECK_ERROR(TAG, ret, "failed to register system : ");
 
     ecs_entity_t player;
@@ -69,8 +79,8 @@ int main(void)
     ret |= ecs_get_component(player, rigidbody_t, &rb);
     ECS_CHECK_ERROR(TAG, ret, "failed to get components : ");
 
-    float dt = 0.1f;
-    ecs_set_system_parameters(physics_system, 1, (void *[]){ &dt });
+    // Shared state lives once in the scene
+    ecs_set_resource(game_time_t, &((game_time_t){ .dt=0.1f }));
 
     // Gameloop
     while (1)
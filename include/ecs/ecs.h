@@ -29,18 +29,163 @@ extern "C" {
 #define ecs_add_component(entity, component, default_value) \
     (ecs_add_component_by_name(entity, #component, (void *)(default_value)) && ((void)sizeof(component), true))
 
+#define ecs_emplace_component(entity, component, dest) \
+    (ecs_emplace_component_by_name(entity, #component, (void **)(dest)) && ((void)sizeof(component), true))
+
+#define ecs_set_component_hooks(component, hooks) \
+    (ecs_set_component_hooks_by_name(#component, hooks) && ((void)sizeof(component), true))
+
 #define ecs_get_component(entity, component, dest) \
     (ecs_get_component_by_name(entity, #component, (void **)(dest)) && ((void)sizeof(component), true))
 
+#define ecs_set_component(entity, component, value) \
+    (ecs_set_component_by_name(entity, #component, (const void *)(value)) && ((void)sizeof(component), true))
+
+#define ecs_get_components(component, data, entities, count) \
+    (ecs_get_components_by_name(#component, (void **)(data), entities, count) && ((void)sizeof(component), true))
+
+#define ecs_sort_component(component, key_fn, incremental) \
+    (ecs_sort_component_by_name(#component, key_fn, incremental) && ((void)sizeof(component), true))
+
 #define ecs_remove_component(entity, component) \
     (ecs_remove_component_by_name(entity, #component) && ((void)sizeof(component), true))
 
+#define ecs_set_component_double_buffered(component, enabled) \
+    (ecs_set_component_double_buffered_by_name(#component, enabled) && ((void)sizeof(component), true))
+
+#define ecs_get_previous_component(entity, component, dest) \
+    (ecs_get_previous_component_by_name(entity, #component, (const void **)(dest)) && ((void)sizeof(component), true))
+
+#define ecs_set_resource(component, value) \
+    (ecs_set_resource_by_name(#component, (void *)(value)) && ((void)sizeof(component), true))
+
+#define ecs_get_resource(component, dest) \
+    (ecs_get_resource_by_name(#component, (void **)(dest)) && ((void)sizeof(component), true))
+
+#define ecs_register_event_channel(event, capacity) \
+    (ecs_register_event_channel_by_name(#event, capacity) && ((void)sizeof(event), true))
+
+#define ecs_publish_events(event, events, count) \
+    (ecs_publish_events_by_name(#event, (const void *)(events), count) && ((void)sizeof(event), true))
+
+#define ecs_consume_events(event, dest, max, count) \
+    (ecs_consume_events_by_name(#event, (void *)(dest), max, count) && ((void)sizeof(event), true))
+
+#define ecs_create_index(index, component, field, key_type, kind) \
+    ecs_create_index_by_name(index, #component, offsetof(component, field), sizeof(((component *)0)->field), key_type, kind)
+
+#define ecs_create_spatial_index(index, component, field, dims, cell_size) \
+    ecs_create_spatial_index_by_name(index, #component, offsetof(component, field), dims, cell_size)
+
+#define ecs_reindex_component(component) \
+    (ecs_reindex_component_by_name(#component) && ((void)sizeof(component), true))
+
 #define ecs_create_signature(signature, ...) \
     ecs_create_signature_by_names(signature, #__VA_ARGS__)
 
 #define ecs_entity_has_component(entity, component) \
     (ecs_entity_has_component_by_name(entity, #component) && ((void)sizeof(component), true))
 
+#define ecs_register_buffer(buffer, element, inline_capacity) \
+    ecs_register_buffer_by_name(#buffer, sizeof(element), inline_capacity)
+
+#define ecs_buffer_append(entity, buffer, values, count) \
+    ecs_buffer_append_by_name(entity, #buffer, (const void *)(values), count)
+
+#define ecs_buffer_clear(entity, buffer) \
+    ecs_buffer_clear_by_name(entity, #buffer)
+
+#define ecs_buffer_get(entity, buffer, data, count) \
+    ecs_buffer_get_by_name(entity, #buffer, (void **)(data), count)
+
+#define ecs_set_component_enabled(entity, component, enabled) \
+    (ecs_set_component_enabled_by_name(entity, #component, enabled) && ((void)sizeof(component), true))
+
+#define ecs_is_component_enabled(entity, component) \
+    (ecs_is_component_enabled_by_name(entity, #component) && ((void)sizeof(component), true))
+
+// Same helpers on an explicit world
+#define ecs_world_register_component(world, component) \
+    (ecs_world_register_component_by_name(world, #component, sizeof(component)) && ((void)sizeof(component), true))
+
+#define ecs_world_add_component(world, entity, component, default_value) \
+    (ecs_world_add_component_by_name(world, entity, #component, (void *)(default_value)) && ((void)sizeof(component), true))
+
+#define ecs_world_emplace_component(world, entity, component, dest) \
+    (ecs_world_emplace_component_by_name(world, entity, #component, (void **)(dest)) && ((void)sizeof(component), true))
+
+#define ecs_world_set_component_hooks(world, component, hooks) \
+    (ecs_world_set_component_hooks_by_name(world, #component, hooks) && ((void)sizeof(component), true))
+
+#define ecs_world_get_component(world, entity, component, dest) \
+    (ecs_world_get_component_by_name(world, entity, #component, (void **)(dest)) && ((void)sizeof(component), true))
+
+#define ecs_world_set_component(world, entity, component, value) \
+    (ecs_world_set_component_by_name(world, entity, #component, (const void *)(value)) && ((void)sizeof(component), true))
+
+#define ecs_world_get_components(world, component, data, entities, count) \
+    (ecs_world_get_components_by_name(world, #component, (void **)(data), entities, count) && ((void)sizeof(component), true))
+
+#define ecs_world_sort_component(world, component, key_fn, incremental) \
+    (ecs_world_sort_component_by_name(world, #component, key_fn, incremental) && ((void)sizeof(component), true))
+
+#define ecs_world_remove_component(world, entity, component) \
+    (ecs_world_remove_component_by_name(world, entity, #component) && ((void)sizeof(component), true))
+
+#define ecs_world_set_component_double_buffered(world, component, enabled) \
+    (ecs_world_set_component_double_buffered_by_name(world, #component, enabled) && ((void)sizeof(component), true))
+
+#define ecs_world_get_previous_component(world, entity, component, dest) \
+    (ecs_world_get_previous_component_by_name(world, entity, #component, (const void **)(dest)) && ((void)sizeof(component), true))
+
+#define ecs_world_set_resource(world, component, value) \
+    (ecs_world_set_resource_by_name(world, #component, (void *)(value)) && ((void)sizeof(component), true))
+
+#define ecs_world_get_resource(world, component, dest) \
+    (ecs_world_get_resource_by_name(world, #component, (void **)(dest)) && ((void)sizeof(component), true))
+
+#define ecs_world_register_event_channel(world, event, capacity) \
+    (ecs_world_register_event_channel_by_name(world, #event, capacity) && ((void)sizeof(event), true))
+
+#define ecs_world_publish_events(world, event, events, count) \
+    (ecs_world_publish_events_by_name(world, #event, (const void *)(events), count) && ((void)sizeof(event), true))
+
+#define ecs_world_consume_events(world, event, dest, max, count) \
+    (ecs_world_consume_events_by_name(world, #event, (void *)(dest), max, count) && ((void)sizeof(event), true))
+
+#define ecs_world_create_index(world, index, component, field, key_type, kind) \
+    ecs_world_create_index_by_name(world, index, #component, offsetof(component, field), sizeof(((component *)0)->field), key_type, kind)
+
+#define ecs_world_create_spatial_index(world, index, component, field, dims, cell_size) \
+    ecs_world_create_spatial_index_by_name(world, index, #component, offsetof(component, field), dims, cell_size)
+
+#define ecs_world_reindex_component(world, component) \
+    (ecs_world_reindex_component_by_name(world, #component) && ((void)sizeof(component), true))
+
+#define ecs_world_create_signature(world, signature, ...) \
+    ecs_world_create_signature_by_names(world, signature, #__VA_ARGS__)
+
+#define ecs_world_entity_has_component(world, entity, component) \
+    (ecs_world_entity_has_component_by_name(world, entity, #component) && ((void)sizeof(component), true))
+
+#define ecs_world_register_buffer(world, buffer, element, inline_capacity) \
+    ecs_world_register_buffer_by_name(world, #buffer, sizeof(element), inline_capacity)
+
+#define ecs_world_buffer_append(world, entity, buffer, values, count) \
+    ecs_world_buffer_append_by_name(world, entity, #buffer, (const void *)(values), count)
+
+#define ecs_world_buffer_clear(world, entity, buffer) \
+    ecs_world_buffer_clear_by_name(world, entity, #buffer)
+
+#define ecs_world_buffer_get(world, entity, buffer, data, count) \
+    ecs_world_buffer_get_by_name(world, entity, #buffer, (void **)(data), count)
+
+#define ecs_world_set_component_enabled(world, entity, component, enabled) \
+    (ecs_world_set_component_enabled_by_name(world, entity, #component, enabled) && ((void)sizeof(component), true))
+
+#define ecs_world_is_component_enabled(world, entity, component) \
+    (ecs_world_is_component_enabled_by_name(world, entity, #component) && ((void)sizeof(component), true))
+
 //------------------------------------------------------------------------------
 // Typedefs and Enums
 //------------------------------------------------------------------------------
@@ -48,7 +193,56 @@ typedef int ecs_err_t;
 typedef uint32_t ecs_entity_t;
 typedef uint32_t ecs_scene_t;
 typedef uint32_t ecs_signature_t;
+typedef uint32_t ecs_prefab_t;
+typedef uint32_t ecs_query_t;
+typedef uint32_t ecs_index_t;
+typedef uint32_t ecs_spatial_index_t;
+typedef struct ecs_world ecs_world_t;
 typedef ecs_err_t (*ecs_system_t)(ecs_entity_t *, int count, void *args[]);
+// Sort keys, ecs_encode_key maps integer and float fields to such keys
+typedef uint64_t (*ecs_sort_key_t)(const void *component);
+
+// Raw view of a component pool. `slots` maps the entities below
+// `slot_count` to their slot in `data`, or to -1. The view is valid until
+// the pool changes.
+typedef struct
+{
+    void *data;
+    const ecs_entity_t *entities;
+    int count;
+    const int *slots;
+    int slot_count;
+} ecs_column_t;
+
+// Called by ecs_parallel_for on a slice of a column, `data` and `entities`
+// pointing to its first slot
+typedef void (*ecs_parallel_fn_t)(void *data, const ecs_entity_t *entities, int count, int worker, void *ctx);
+
+// Component lifecycle hooks, each working on `count` consecutive components.
+// `move` relocates components, the source is not destroyed afterwards.
+// Components with a `dtor` but no `copy` cannot be set or scattered.
+typedef struct
+{
+    void (*ctor)(void *dst, int count);
+    void (*dtor)(void *ptr, int count);
+    void (*move)(void *dst, void *src, int count);
+    void (*copy)(void *dst, const void *src, int count);
+} ecs_component_hooks_t;
+
+// Hash indices look up equal keys, ordered indices key ranges
+typedef enum
+{
+    ECS_INDEX_HASH,
+    ECS_INDEX_ORDERED,
+} ecs_index_kind_t;
+
+// Integer keys are 1, 2, 4 or 8 bytes wide, float keys 4 or 8
+typedef enum
+{
+    ECS_KEY_INT,
+    ECS_KEY_UINT,
+    ECS_KEY_FLOAT,
+} ecs_key_type_t;
 
 typedef enum 
 {
@@ -59,38 +253,383 @@ typedef enum
     ECS_SYSTEM_EVENT_COUNT
 } ecs_system_event_t;
 
+typedef struct
+{
+    int interval;   // Run once every `interval` passes, 0 or 1 runs every pass
+    int phase;      // Pass offset within the interval
+    int slices;     // Run over 1/`slices` of the entities per run, rotating, 0 or 1 runs all
+} ecs_system_config_t;
+
+typedef struct
+{
+    uint64_t runs;
+    uint64_t entities;      // Entities handed to the system over all runs
+    uint64_t time_ns;
+    int last_count;         // Size and offset of the slice of the last run
+    int last_offset;
+    uint64_t last_time_ns;
+} ecs_system_stats_t;
+
+typedef struct
+{
+    size_t used;            // Allocated since the end of the last pass
+    size_t capacity;
+    size_t high_water;      // Most ever allocated within a pass
+} ecs_scratch_stats_t;
+
 //------------------------------------------------------------------------------
 // Function Prototypes
 //------------------------------------------------------------------------------
 extern ecs_err_t ecs_init();
 extern ecs_err_t ecs_terminate();
 
+// Scenes are registered worlds, bound per thread. The functions below
+// without a world parameter operate on the scene bound to the calling thread,
+// or on the world running the current system.
 extern ecs_err_t ecs_create_scene(ecs_scene_t *scene);
 extern ecs_err_t ecs_bind_scene(ecs_scene_t scene);
 extern ecs_err_t ecs_free_scene();
+extern ecs_err_t ecs_get_scene_world(ecs_scene_t scene, ecs_world_t **world);
+extern ecs_world_t *ecs_get_world();
+
+// Moves entities to another scene, relocating their components column by
+// column into the pools of the same name, which must have the same size.
+// `out` receives the new ids and enable bits are kept. Entities with a
+// parent or children are refused. Nothing changes when an entity or a pool
+// is missing.
+extern ecs_err_t ecs_move_entities(ecs_scene_t src, ecs_scene_t dst, const ecs_entity_t *entities, int count, ecs_entity_t *out);
 
-// Memory optimisations
+// Forking marks the current state of the scene, ecs_restore_scene returns
+// to it at a cost proportional to the pages changed since, and the fork
+// point stays set for the next restore. ecs_commit_scene keeps the changes
+// and drops the fork point. Entities, components, queries, value indices
+// and resources are restored. Components with hooks or double buffering
+// cannot be forked, and components cannot be unregistered during a fork.
+extern ecs_err_t ecs_fork_scene();
+extern ecs_err_t ecs_restore_scene();
+extern ecs_err_t ecs_commit_scene();
+
+// Snapshot history of the last `frames` frames, as one keyframe and the
+// changed bytes of each following frame. Entities, components and
+// resources are recorded, queries and value and spatial indices are rebuilt on restore.
+// Components with hooks cannot be recorded. Changing the capacity clears
+// the history, 0 disables it.
+extern ecs_err_t ecs_set_snapshot_capacity(int frames);
+extern ecs_err_t ecs_take_snapshot(uint64_t *frame);
+extern ecs_err_t ecs_restore_snapshot(uint64_t frame);
+extern ecs_err_t ecs_get_snapshot_range(uint64_t *first, uint64_t *last, size_t *bytes);
+
+// Checksum of the scene to detect desyncs between peers. Pools keep a
+// running sum of per-chunk hashes, only the chunks written since the last
+// call are hashed again, so pointers must be fetched again after a
+// checksum to be written. Padding bytes are hashed too, buffers hash their
+// elements only, and the result is reproducible across runs and machines
+// sharing the component layouts.
+extern ecs_err_t ecs_scene_checksum(uint64_t *checksum);
+
+// Memory optimisations. Shrinking gives back the ids past the highest live
+// entity and the slack of the entity arrays and of the maps keyed by entity.
 extern ecs_err_t ecs_reserve_entities(ecs_entity_t max_entities);
 extern ecs_err_t ecs_shrink_entities();
+// Incremental compaction, resumed where the previous call stopped. Besides
+// shrinking the entities, it orders pools and query lists by entity id,
+// except pools sorted with ecs_sort_component and the queries requiring
+// them, gives back the slack of pools and indices and rebuilds spatial
+// indices holding removed entries.
+// Steps run until `budget_us` microseconds are spent, at least one, at most
+// a whole pass, 0 for a whole pass. Large pools are ordered a few thousand
+// slots per step. Pointers to components are invalidated.
+// Both are refused while forked.
+extern ecs_err_t ecs_compact(int budget_us);
 
 extern ecs_err_t ecs_create_entity(ecs_entity_t *entity);
 extern ecs_err_t ecs_delete_entity(ecs_entity_t entity);
 
+// Reserve entity ids from any thread without locking. Reserved entities are
+// created at the next flush: ecs_flush_entities, the end of
+// ecs_listen_systems or any other structural change. Structural changes must
+// not run concurrently with reservations.
+extern ecs_err_t ecs_reserve_entity_ids(int count, ecs_entity_t *entities);
+extern ecs_err_t ecs_flush_entities();
+
+// Parent/child relationships, kept in depth-first order so parents always
+// precede their descendants. ecs_get_hierarchy returns that order with the
+// position of the parent of every entity, -1 for roots. The descendants of
+// an entity follow it contiguously, and are deleted along with it.
+// Returned arrays are valid until the next hierarchy change.
+extern ecs_err_t ecs_set_parent(ecs_entity_t entity, ecs_entity_t parent);
+extern ecs_err_t ecs_get_parent(ecs_entity_t entity, ecs_entity_t *parent);
+extern ecs_err_t ecs_get_descendants(ecs_entity_t entity, const ecs_entity_t **descendants, int *count);
+extern ecs_err_t ecs_get_hierarchy(const ecs_entity_t **entities, const int **parents, int *count);
+
+// Prefabs capture the signature and component values of a template entity
+extern ecs_err_t ecs_create_prefab(ecs_prefab_t *prefab, ecs_entity_t entity);
+extern ecs_err_t ecs_free_prefab(ecs_prefab_t prefab);
+extern ecs_err_t ecs_instantiate(ecs_prefab_t prefab, int count, ecs_entity_t *entities);
+
 extern ecs_err_t ecs_register_component_by_name(const char *name, size_t size);
 extern ecs_err_t ecs_unregister_component_by_name(const char *name);
 extern ecs_err_t ecs_add_component_by_name(ecs_entity_t entity, const char *name, void *default_value);
-extern inline ecs_err_t ecs_remove_component_by_name(ecs_entity_t entity, const char *name);
+extern ecs_err_t ecs_emplace_component_by_name(ecs_entity_t entity, const char *name, void **dest);
+extern ecs_err_t ecs_remove_component_by_name(ecs_entity_t entity, const char *name);
 extern ecs_err_t ecs_get_component_by_name(ecs_entity_t entity, const char *name, void **dest);
+extern ecs_err_t ecs_set_component_by_name(ecs_entity_t entity, const char *name, const void *value);
+
+// Dense component column, valid until the next change of the component
+extern ecs_err_t ecs_get_components_by_name(const char *name, void **data, ecs_entity_t **entities, int *count);
+
+// Access by component id, ids stay valid until the component is unregistered.
+// Every slot of a column may be written.
+extern ecs_err_t ecs_get_component_id(const char *name, int *id);
+extern ecs_err_t ecs_get_component_by_id(ecs_entity_t entity, int id, void **dest);
+extern ecs_err_t ecs_get_column(int id, ecs_column_t *column);
+
+// Copy the components of a list of entities to or from `stride` spaced
+// elements, 0 for packed ones. Large batches over large pools are copied in
+// slot order. Nothing is copied when an entity lacks the component.
+extern ecs_err_t ecs_gather_components(int id, const ecs_entity_t *entities, int count, void *dst, size_t stride);
+extern ecs_err_t ecs_scatter_components(int id, const ecs_entity_t *entities, int count, const void *src, size_t stride);
+
+// Reorders the component pool by key with a radix sort, along with the
+// entities of the queries requiring it. The incremental mode first tries an
+// insertion sort, fast on pools still sorted from the previous frame.
+extern ecs_err_t ecs_sort_component_by_name(const char *name, ecs_sort_key_t key_fn, bool incremental);
+extern uint64_t ecs_encode_key(ecs_key_type_t type, size_t size, const void *value);
 extern bool ecs_entity_has_component_by_name(ecs_entity_t entity, const char *name);
 
+// Buffer components hold a variable number of elements per entity, the
+// first `inline_capacity` ones in the component pool and longer buffers in
+// blocks pooled by the scene. Buffer names need not be types. Appending
+// adds the buffer to the entity, and removing it or deleting the entity
+// releases its block. Buffers start empty, are not written by
+// ecs_set_component, and cannot be forked or recorded in snapshots.
+// Elements are 16 byte aligned and valid until the next change of a buffer
+// of the same name.
+extern ecs_err_t ecs_register_buffer_by_name(const char *name, size_t element_size, int inline_capacity);
+extern ecs_err_t ecs_buffer_append_by_name(ecs_entity_t entity, const char *name, const void *values, int count);
+extern ecs_err_t ecs_buffer_clear_by_name(ecs_entity_t entity, const char *name);
+extern ecs_err_t ecs_buffer_get_by_name(ecs_entity_t entity, const char *name, void **data, int *count);
+
+// Disabled entities, and entities with a disabled component required by a
+// query, keep their components and query membership but are skipped by
+// ecs_query_entities and systems. Toggling only flips a bit of the entity
+// in each query holding it. Removing a component enables it again. Systems
+// are called on each run of enabled entities. While a query has disabled
+// members ecs_query_entities returns a filtered copy in scratch memory,
+// valid until the next call for the same query on the thread.
+extern ecs_err_t ecs_set_entity_enabled(ecs_entity_t entity, bool enabled);
+extern bool ecs_is_entity_enabled(ecs_entity_t entity);
+extern ecs_err_t ecs_set_component_enabled_by_name(ecs_entity_t entity, const char *name, bool enabled);
+extern bool ecs_is_component_enabled_by_name(ecs_entity_t entity, const char *name);
+
+// Hooks can only be set while the component has no instance
+extern ecs_err_t ecs_set_component_hooks_by_name(const char *name, const ecs_component_hooks_t *hooks);
+
+// Double buffered components keep the state of the previous pass readable
+// while systems write the current one. Buffers flip at the end of
+// ecs_listen_systems. The generation is odd while the previous buffer is
+// written, readers on other threads copy what they need and retry when the
+// generation was odd or has changed by the time they are done.
+extern ecs_err_t ecs_set_component_double_buffered_by_name(const char *name, bool enabled);
+extern ecs_err_t ecs_get_previous_component_by_name(ecs_entity_t entity, const char *name, const void **dest);
+extern ecs_err_t ecs_get_previous_components_by_name(const char *name, const void **data, const ecs_entity_t **entities, int *count, uint32_t *generation);
+extern ecs_err_t ecs_get_component_generation_by_name(const char *name, uint32_t *generation);
+
 extern ecs_err_t ecs_create_signature_by_names(ecs_signature_t *signature, const char *names);
 
+// Resources are registered components with a single scene-level value
+extern ecs_err_t ecs_set_resource_by_name(const char *name, void *value);
+extern ecs_err_t ecs_get_resource_by_name(const char *name, void **dest);
+
+// Event channels are registered components carried by bounded lock-free
+// queues, published to and consumed from any thread. Each event is consumed
+// once. Events not consumed by the end of the next ecs_listen_systems pass
+// are dropped. Publishing to a full channel returns ECS_ERR_MEM.
+extern ecs_err_t ecs_register_event_channel_by_name(const char *name, int capacity);
+extern ecs_err_t ecs_publish_events_by_name(const char *name, const void *events, int count);
+extern ecs_err_t ecs_consume_events_by_name(const char *name, void *dest, int max, int *count);
+
+// Value indices map a component field to the entities holding each value.
+// They follow ecs_add_component, ecs_set_component, removals and
+// instantiation. Components emplaced or written through the pointer of
+// ecs_get_component are indexed again by ecs_reindex_component. Returned
+// entities stay valid until the next change of the component.
+extern ecs_err_t ecs_create_index_by_name(ecs_index_t *index, const char *name, size_t offset, size_t size, ecs_key_type_t key_type, ecs_index_kind_t kind);
+extern ecs_err_t ecs_free_index(ecs_index_t index);
+extern ecs_err_t ecs_reindex_component_by_name(const char *name);
+extern ecs_err_t ecs_index_find(ecs_index_t index, const void *key, ecs_entity_t **entities, int *count);
+// Inclusive range, ordered indices only
+extern ecs_err_t ecs_index_range(ecs_index_t index, const void *min, const void *max, ecs_entity_t **entities, int *count);
+
+// Spatial indices hash a float[2] or float[3] position field into a grid of
+// `cell_size` cells, stored as flat arrays sorted by cell. Writes are picked
+// up from change tracking by the next query, which rebuilds the index when
+// too many entities changed cell. Threads are used by explicit rebuilds.
+// Returned entities stay valid until the next query on the index.
+extern ecs_err_t ecs_create_spatial_index_by_name(ecs_spatial_index_t *index, const char *name, size_t offset, int dims, float cell_size);
+extern ecs_err_t ecs_free_spatial_index(ecs_spatial_index_t index);
+extern ecs_err_t ecs_rebuild_spatial_index(ecs_spatial_index_t index, int threads);
+extern ecs_err_t ecs_spatial_query_radius(ecs_spatial_index_t index, const float *center, float radius, ecs_entity_t **entities, int *count);
+// Inclusive box
+extern ecs_err_t ecs_spatial_query_aabb(ecs_spatial_index_t index, const float *min, const float *max, ecs_entity_t **entities, int *count);
+
+// Queries match entities having every component of `with` and none of
+// `without`, `optional` lists components that may be accessed when present.
+// Matches are cached and updated on each structural change.
+extern ecs_err_t ecs_create_query(ecs_query_t *query, ecs_signature_t with, ecs_signature_t without, ecs_signature_t optional);
+extern ecs_err_t ecs_free_query(ecs_query_t query);
+extern ecs_err_t ecs_query_entities(ecs_query_t query, ecs_entity_t **entities, int *count);
+
 extern ecs_err_t ecs_register_system(ecs_system_t system, ecs_signature_t signature, ecs_system_event_t event);
+extern ecs_err_t ecs_register_query_system(ecs_system_t system, ecs_query_t query, ecs_system_event_t event);
+extern ecs_err_t ecs_register_scheduled_system(ecs_system_t system, ecs_query_t query, ecs_system_event_t event, const ecs_system_config_t *config);
 extern ecs_err_t ecs_unregister_system(ecs_system_t system);
 extern ecs_err_t ecs_set_system_parameters(ecs_system_t system, int argc, void *args[]);
+extern ecs_err_t ecs_set_system_resources(ecs_system_t system, ecs_signature_t read, ecs_signature_t write);
+// Systems publishing an event channel run before the systems consuming it
+extern ecs_err_t ecs_set_system_events(ecs_system_t system, ecs_signature_t publish, ecs_signature_t consume);
 extern ecs_err_t ecs_call_system(ecs_system_t system);
 extern ecs_err_t ecs_listen_systems(ecs_system_event_t event);
+
+// Run adjacent systems over the same query chunk by chunk, every system
+// on `chunk_size` entities before the next chunk. Rate limited, amortised
+// and resource or event conflicting systems are never fused. 0 disables fusion.
+extern ecs_err_t ecs_set_system_fusion(int chunk_size);
 extern ecs_err_t ecs_get_system_status(ecs_system_t system, ecs_err_t *ret);
+extern ecs_err_t ecs_get_system_stats(ecs_system_t system, ecs_system_stats_t *stats);
+
+// Bump allocated scratch memory of the scene, 16 byte aligned, released all
+// at once at the end of ecs_listen_systems. Scenes each have their own, and
+// so does every ecs_parallel_for worker index, so systems and workers
+// allocate without locking. NULL when out of memory.
+extern void *ecs_scratch_alloc(size_t size);
+// Preallocates capacity, typically to the high water mark
+extern ecs_err_t ecs_reserve_scratch(size_t size);
+extern ecs_err_t ecs_get_scratch_stats(ecs_scratch_stats_t *stats);
+
+// Splits a column in contiguous slices, one per worker, 0 workers for one
+// per CPU, with at least a few thousand slots each. Workers run with the
+// scene bound and must not add or remove components. They run on threads
+// kept by the scene between calls, calls from a worker run on its thread.
+// In NUMA mode workers are pinned to nodes in order, each node processing
+// a contiguous range of slots, and the pool is moved before they run so that
+// every slice is first touched by its worker. It moves again only when it grows, moves or
+// is split between another number of workers. Single node machines ignore
+// the mode.
+extern ecs_err_t ecs_set_numa_mode(bool enabled);
+extern ecs_err_t ecs_parallel_for(int id, int workers, ecs_parallel_fn_t fn, void *ctx);
+// Bytes of the column resident on each node, up to `max_nodes` of them
+extern ecs_err_t ecs_get_numa_occupancy(int id, size_t *bytes, int max_nodes, int *node_count);
+
+// Explicit world API. Worlds share no mutable state, so independent worlds
+// can be used concurrently from different threads without locking.
+extern ecs_err_t ecs_world_create(ecs_world_t **world);
+extern ecs_err_t ecs_world_free(ecs_world_t *world);
+// Never given to another world, even one allocated at the same address
+extern uint64_t ecs_world_get_uid(ecs_world_t *world);
+
+extern ecs_err_t ecs_world_fork(ecs_world_t *world);
+extern ecs_err_t ecs_world_restore_fork(ecs_world_t *world);
+extern ecs_err_t ecs_world_commit_fork(ecs_world_t *world);
+
+extern ecs_err_t ecs_world_set_snapshot_capacity(ecs_world_t *world, int frames);
+extern ecs_err_t ecs_world_take_snapshot(ecs_world_t *world, uint64_t *frame);
+extern ecs_err_t ecs_world_restore_snapshot(ecs_world_t *world, uint64_t frame);
+extern ecs_err_t ecs_world_get_snapshot_range(ecs_world_t *world, uint64_t *first, uint64_t *last, size_t *bytes);
+
+extern ecs_err_t ecs_world_checksum(ecs_world_t *world, uint64_t *checksum);
+
+extern ecs_err_t ecs_world_reserve_entities(ecs_world_t *world, ecs_entity_t max_entities);
+extern ecs_err_t ecs_world_shrink_entities(ecs_world_t *world);
+extern ecs_err_t ecs_world_compact(ecs_world_t *world, int budget_us);
+
+extern ecs_err_t ecs_world_create_entity(ecs_world_t *world, ecs_entity_t *entity);
+extern ecs_err_t ecs_world_move_entities(ecs_world_t *src, ecs_world_t *dst, const ecs_entity_t *entities, int count, ecs_entity_t *out);
+extern ecs_err_t ecs_world_delete_entity(ecs_world_t *world, ecs_entity_t entity);
+extern ecs_err_t ecs_world_reserve_entity_ids(ecs_world_t *world, int count, ecs_entity_t *entities);
+extern ecs_err_t ecs_world_flush_entities(ecs_world_t *world);
+
+extern ecs_err_t ecs_world_set_parent(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t parent);
+extern ecs_err_t ecs_world_get_parent(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t *parent);
+extern ecs_err_t ecs_world_get_descendants(ecs_world_t *world, ecs_entity_t entity, const ecs_entity_t **descendants, int *count);
+extern ecs_err_t ecs_world_get_hierarchy(ecs_world_t *world, const ecs_entity_t **entities, const int **parents, int *count);
+
+extern ecs_err_t ecs_world_create_prefab(ecs_world_t *world, ecs_prefab_t *prefab, ecs_entity_t entity);
+extern ecs_err_t ecs_world_free_prefab(ecs_world_t *world, ecs_prefab_t prefab);
+extern ecs_err_t ecs_world_instantiate(ecs_world_t *world, ecs_prefab_t prefab, int count, ecs_entity_t *entities);
+
+extern ecs_err_t ecs_world_register_component_by_name(ecs_world_t *world, const char *name, size_t size);
+extern ecs_err_t ecs_world_unregister_component_by_name(ecs_world_t *world, const char *name);
+extern ecs_err_t ecs_world_add_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, void *default_value);
+extern ecs_err_t ecs_world_emplace_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, void **dest);
+extern ecs_err_t ecs_world_set_component_hooks_by_name(ecs_world_t *world, const char *name, const ecs_component_hooks_t *hooks);
+extern ecs_err_t ecs_world_remove_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name);
+extern ecs_err_t ecs_world_get_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, void **dest);
+extern ecs_err_t ecs_world_set_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, const void *value);
+extern ecs_err_t ecs_world_get_components_by_name(ecs_world_t *world, const char *name, void **data, ecs_entity_t **entities, int *count);
+extern ecs_err_t ecs_world_get_component_id(ecs_world_t *world, const char *name, int *id);
+extern ecs_err_t ecs_world_get_component_by_id(ecs_world_t *world, ecs_entity_t entity, int id, void **dest);
+extern ecs_err_t ecs_world_get_column(ecs_world_t *world, int id, ecs_column_t *column);
+extern ecs_err_t ecs_world_gather_components(ecs_world_t *world, int id, const ecs_entity_t *entities, int count, void *dst, size_t stride);
+extern ecs_err_t ecs_world_scatter_components(ecs_world_t *world, int id, const ecs_entity_t *entities, int count, const void *src, size_t stride);
+extern ecs_err_t ecs_world_sort_component_by_name(ecs_world_t *world, const char *name, ecs_sort_key_t key_fn, bool incremental);
+extern bool ecs_world_entity_has_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name);
+extern ecs_err_t ecs_world_register_buffer_by_name(ecs_world_t *world, const char *name, size_t element_size, int inline_capacity);
+extern ecs_err_t ecs_world_buffer_append_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, const void *values, int count);
+extern ecs_err_t ecs_world_buffer_clear_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name);
+extern ecs_err_t ecs_world_buffer_get_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, void **data, int *count);
+extern ecs_err_t ecs_world_set_entity_enabled(ecs_world_t *world, ecs_entity_t entity, bool enabled);
+extern bool ecs_world_is_entity_enabled(ecs_world_t *world, ecs_entity_t entity);
+extern ecs_err_t ecs_world_set_component_enabled_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, bool enabled);
+extern bool ecs_world_is_component_enabled_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name);
+extern ecs_err_t ecs_world_set_component_double_buffered_by_name(ecs_world_t *world, const char *name, bool enabled);
+extern ecs_err_t ecs_world_get_previous_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, const void **dest);
+extern ecs_err_t ecs_world_get_previous_components_by_name(ecs_world_t *world, const char *name, const void **data, const ecs_entity_t **entities, int *count, uint32_t *generation);
+extern ecs_err_t ecs_world_get_component_generation_by_name(ecs_world_t *world, const char *name, uint32_t *generation);
+
+extern ecs_err_t ecs_world_create_signature_by_names(ecs_world_t *world, ecs_signature_t *signature, const char *names);
+
+extern ecs_err_t ecs_world_set_resource_by_name(ecs_world_t *world, const char *name, void *value);
+extern ecs_err_t ecs_world_get_resource_by_name(ecs_world_t *world, const char *name, void **dest);
+
+extern ecs_err_t ecs_world_register_event_channel_by_name(ecs_world_t *world, const char *name, int capacity);
+extern ecs_err_t ecs_world_publish_events_by_name(ecs_world_t *world, const char *name, const void *events, int count);
+extern ecs_err_t ecs_world_consume_events_by_name(ecs_world_t *world, const char *name, void *dest, int max, int *count);
+
+extern ecs_err_t ecs_world_create_index_by_name(ecs_world_t *world, ecs_index_t *index, const char *name, size_t offset, size_t size, ecs_key_type_t key_type, ecs_index_kind_t kind);
+extern ecs_err_t ecs_world_free_index(ecs_world_t *world, ecs_index_t index);
+extern ecs_err_t ecs_world_reindex_component_by_name(ecs_world_t *world, const char *name);
+extern ecs_err_t ecs_world_index_find(ecs_world_t *world, ecs_index_t index, const void *key, ecs_entity_t **entities, int *count);
+extern ecs_err_t ecs_world_index_range(ecs_world_t *world, ecs_index_t index, const void *min, const void *max, ecs_entity_t **entities, int *count);
+
+extern ecs_err_t ecs_world_create_spatial_index_by_name(ecs_world_t *world, ecs_spatial_index_t *index, const char *name, size_t offset, int dims, float cell_size);
+extern ecs_err_t ecs_world_free_spatial_index(ecs_world_t *world, ecs_spatial_index_t index);
+extern ecs_err_t ecs_world_rebuild_spatial_index(ecs_world_t *world, ecs_spatial_index_t index, int threads);
+extern ecs_err_t ecs_world_spatial_query_radius(ecs_world_t *world, ecs_spatial_index_t index, const float *center, float radius, ecs_entity_t **entities, int *count);
+extern ecs_err_t ecs_world_spatial_query_aabb(ecs_world_t *world, ecs_spatial_index_t index, const float *min, const float *max, ecs_entity_t **entities, int *count);
+
+extern ecs_err_t ecs_world_create_query(ecs_world_t *world, ecs_query_t *query, ecs_signature_t with, ecs_signature_t without, ecs_signature_t optional);
+extern ecs_err_t ecs_world_free_query(ecs_world_t *world, ecs_query_t query);
+extern ecs_err_t ecs_world_query_entities(ecs_world_t *world, ecs_query_t query, ecs_entity_t **entities, int *count);
+
+extern ecs_err_t ecs_world_register_system(ecs_world_t *world, ecs_system_t system, ecs_signature_t signature, ecs_system_event_t event);
+extern ecs_err_t ecs_world_register_query_system(ecs_world_t *world, ecs_system_t system, ecs_query_t query, ecs_system_event_t event);
+extern ecs_err_t ecs_world_register_scheduled_system(ecs_world_t *world, ecs_system_t system, ecs_query_t query, ecs_system_event_t event, const ecs_system_config_t *config);
+extern ecs_err_t ecs_world_unregister_system(ecs_world_t *world, ecs_system_t system);
+extern ecs_err_t ecs_world_set_system_parameters(ecs_world_t *world, ecs_system_t system, int argc, void *args[]);
+extern ecs_err_t ecs_world_set_system_resources(ecs_world_t *world, ecs_system_t system, ecs_signature_t read, ecs_signature_t write);
+extern ecs_err_t ecs_world_set_system_events(ecs_world_t *world, ecs_system_t system, ecs_signature_t publish, ecs_signature_t consume);
+extern ecs_err_t ecs_world_call_system(ecs_world_t *world, ecs_system_t system);
+extern ecs_err_t ecs_world_listen_systems(ecs_world_t *world, ecs_system_event_t event);
+extern ecs_err_t ecs_world_set_system_fusion(ecs_world_t *world, int chunk_size);
+extern ecs_err_t ecs_world_get_system_status(ecs_world_t *world, ecs_system_t system, ecs_err_t *ret);
+extern ecs_err_t ecs_world_get_system_stats(ecs_world_t *world, ecs_system_t system, ecs_system_stats_t *stats);
+extern void *ecs_world_scratch_alloc(ecs_world_t *world, size_t size);
+extern ecs_err_t ecs_world_reserve_scratch(ecs_world_t *world, size_t size);
+extern ecs_err_t ecs_world_get_scratch_stats(ecs_world_t *world, ecs_scratch_stats_t *stats);
+extern ecs_err_t ecs_world_set_numa_mode(ecs_world_t *world, bool enabled);
+extern ecs_err_t ecs_world_parallel_for(ecs_world_t *world, int id, int workers, ecs_parallel_fn_t fn, void *ctx);
+extern ecs_err_t ecs_world_get_numa_occupancy(ecs_world_t *world, int id, size_t *bytes, int max_nodes, int *node_count);
 
 //------------------------------------------------------------------------------
 // Inline Functions
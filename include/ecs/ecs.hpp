@@ -0,0 +1,299 @@
+/**
+ * @file        : ecs
+ * @brief       : Header-only C++14 front end over the world API
+ */
+
+#ifndef ECS_HPP
+#define ECS_HPP
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "ecs.h"
+#include "ecs_err.h"
+
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//------------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------------
+// Names a component type the way the C macros do, from its spelling. Used
+// at global scope, once per type.
+#define ECS_COMPONENT_NAME(type) \
+    namespace ecs { template <> struct component_traits<type> { static const char *name() { return #type; } }; }
+
+// Type-safe C++14 front end over the explicit world API. Components are
+// registered under an explicit name, so C code keeps reaching them with the
+// usual macros.
+namespace ecs
+{
+
+//------------------------------------------------------------------------------
+// Component traits
+//------------------------------------------------------------------------------
+// Specialised by ECS_COMPONENT_NAME, or by hand to register a component
+// under another name
+template <class T>
+struct component_traits
+{
+    static_assert(sizeof(T) == 0, "component types are named with ECS_COMPONENT_NAME");
+};
+
+namespace detail
+{
+
+template <class T>
+void construct(void *dst, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        new (static_cast<T *>(dst) + i) T();
+    }
+}
+
+template <class T>
+void destroy(void *ptr, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        (static_cast<T *>(ptr) + i)->~T();
+    }
+}
+
+// The library drops moved-from slots without destroying them
+template <class T>
+void relocate(void *dst, void *src, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        T *from = static_cast<T *>(src) + i;
+        new (static_cast<T *>(dst) + i) T(std::move(*from));
+        from->~T();
+    }
+}
+
+template <class T>
+void copy(void *dst, const void *src, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        new (static_cast<T *>(dst) + i) T(static_cast<const T *>(src)[i]);
+    }
+}
+
+// Hooks left out for types without the matching constructor
+template <class T, bool = std::is_default_constructible<T>::value>
+struct construct_hook
+{
+    static void (*get())(void *, int) { return construct<T>; }
+};
+
+template <class T>
+struct construct_hook<T, false>
+{
+    static void (*get())(void *, int) { return nullptr; }
+};
+
+template <class T, bool = std::is_copy_constructible<T>::value>
+struct copy_hook
+{
+    static void (*get())(void *, const void *, int) { return copy<T>; }
+};
+
+template <class T>
+struct copy_hook<T, false>
+{
+    static void (*get())(void *, const void *, int) { return nullptr; }
+};
+
+// Ids are resolved once per type, thread and world, worlds being told
+// apart by their uid since a new one can take the address of a freed one
+template <class T>
+struct component_id
+{
+    static int get(ecs_world_t *world)
+    {
+        static thread_local uint64_t cached_uid = 0;
+        static thread_local int id = -1;
+        uint64_t uid = ecs_world_get_uid(world);
+        if (cached_uid != uid)
+        {
+            if (ecs_world_get_component_id(world, component_traits<T>::name(), &id) != ECS_OK)
+            {
+                return -1;
+            }
+            cached_uid = uid;
+        }
+
+        return id;
+    }
+};
+
+template <class T>
+using column_type = typename std::remove_cv<T>::type;
+
+} // namespace detail
+
+//------------------------------------------------------------------------------
+// World
+//------------------------------------------------------------------------------
+// Non-owning handle, copied by value. Ids cached for a world are stale once
+// one of its components is unregistered.
+class world
+{
+public:
+    explicit world(ecs_world_t *handle) : handle_(handle) {}
+
+    // World bound to the calling thread, or running the current system
+    static world bound() { return world(ecs_get_world()); }
+
+    ecs_world_t *handle() const { return handle_; }
+
+    ecs_err_t create_entity(ecs_entity_t *entity) { return ecs_world_create_entity(handle_, entity); }
+    ecs_err_t delete_entity(ecs_entity_t entity) { return ecs_world_delete_entity(handle_, entity); }
+
+    // Types that are not trivially copyable get lifecycle hooks
+    template <class T>
+    ecs_err_t register_component()
+    {
+        ecs_err_t ret = ecs_world_register_component_by_name(handle_, component_traits<T>::name(), sizeof(T));
+        if (ret != ECS_OK || std::is_trivially_copyable<T>::value)
+        {
+            return ret;
+        }
+
+        ecs_component_hooks_t hooks = { detail::construct_hook<T>::get(), detail::destroy<T>, detail::relocate<T>, detail::copy_hook<T>::get() };
+        return ecs_world_set_component_hooks_by_name(handle_, component_traits<T>::name(), &hooks);
+    }
+
+    template <class T>
+    ecs_err_t unregister_component()
+    {
+        return ecs_world_unregister_component_by_name(handle_, component_traits<T>::name());
+    }
+
+    template <class T>
+    ecs_err_t add(ecs_entity_t entity, T &&value)
+    {
+        using U = typename std::decay<T>::type;
+        if (std::is_trivially_copyable<U>::value)
+        {
+            return ecs_world_add_component_by_name(handle_, entity, component_traits<U>::name(), (void *)std::addressof(value));
+        }
+
+        // Constructed in place, as ecs_emplace_component
+        void *slot;
+        ecs_err_t ret = ecs_world_emplace_component_by_name(handle_, entity, component_traits<U>::name(), &slot);
+        if (ret == ECS_OK)
+        {
+            new (slot) U(std::forward<T>(value));
+        }
+
+        return ret;
+    }
+
+    template <class T>
+    ecs_err_t remove(ecs_entity_t entity)
+    {
+        return ecs_world_remove_component_by_name(handle_, entity, component_traits<T>::name());
+    }
+
+    // Copied in by the copy hook, so the type must be copy constructible
+    template <class T>
+    ecs_err_t set(ecs_entity_t entity, const T &value)
+    {
+        static_assert(std::is_copy_constructible<T>::value, "set() copies the value, move-only components are added instead");
+        return ecs_world_set_component_by_name(handle_, entity, component_traits<T>::name(), std::addressof(value));
+    }
+
+    // nullptr when the entity has no such component
+    template <class T>
+    T *get(ecs_entity_t entity)
+    {
+        void *comp;
+        int id = detail::component_id<detail::column_type<T>>::get(handle_);
+        if (id < 0 || ecs_world_get_component_by_id(handle_, entity, id, &comp) != ECS_OK)
+        {
+            return nullptr;
+        }
+
+        return static_cast<T *>(comp);
+    }
+
+    // Calls fn(entity, Ts &...) on every enabled entity owning all the
+    // components, in the order of their query. Each column is walked from
+    // the slot after the previous match and only looked up where its order
+    // departs from the query, so columns ordered alike by compaction or
+    // sorting are read linearly. Components must not be added or removed
+    // meanwhile.
+    template <class... Ts, class Fn>
+    ecs_err_t each(Fn &&fn)
+    {
+        constexpr int count = sizeof...(Ts);
+        int ids[count] = { detail::component_id<detail::column_type<Ts>>::get(handle_)... };
+        ecs_signature_t with = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            if (ids[i] < 0)
+            {
+                return ECS_ERR_NULL;
+            }
+            with |= 1u << ids[i];
+        }
+
+        // Shares the query of a system or caller with the same terms, and
+        // holds no reference past the call
+        ecs_query_t query;
+        ecs_err_t ret = ecs_world_create_query(handle_, &query, with, 0, 0);
+        if (ret != ECS_OK)
+        {
+            return ret;
+        }
+
+        ecs_entity_t *entities;
+        int entity_count;
+        ecs_column_t columns[count];
+        ret = ecs_world_query_entities(handle_, query, &entities, &entity_count);
+        for (int i = 0; i < count && ret == ECS_OK; ++i)
+        {
+            ret = ecs_world_get_column(handle_, ids[i], &columns[i]);
+        }
+        if (ret == ECS_OK)
+        {
+            each_entities<Ts...>(columns, entities, entity_count, fn, std::index_sequence_for<Ts...>());
+        }
+        ecs_world_free_query(handle_, query);
+
+        return ret;
+    }
+
+private:
+    template <class... Ts, class Fn, size_t... I>
+    static void each_entities(const ecs_column_t *columns, const ecs_entity_t *entities, int entity_count, Fn &fn, std::index_sequence<I...>)
+    {
+        constexpr int count = sizeof...(Ts);
+        int cursors[count] = {};
+        for (int i = 0; i < entity_count; ++i)
+        {
+            ecs_entity_t entity = entities[i];
+            for (int c = 0; c < count; ++c)
+            {
+                if (cursors[c] >= columns[c].count || columns[c].entities[cursors[c]] != entity)
+                {
+                    cursors[c] = columns[c].slots[entity];
+                }
+            }
+
+            fn(entity, static_cast<Ts *>(columns[I].data)[cursors[I]++]...);
+        }
+    }
+
+    ecs_world_t *handle_;
+};
+
+} // namespace ecs
+
+#endif /* ECS_HPP */
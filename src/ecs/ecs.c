@@ -4,23 +4,68 @@
  * @created     : Jeudi jan 02, 2025 01:05:34 CET
  */
 
+// Thread affinity and page queries
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 //------------------------------------------------------------------------------
 // Includes
 //------------------------------------------------------------------------------
 #include "ecs/ecs.h"
 #include "ecs/ecs_err.h"
-#include "../src/utils/itoi_map.h"
 #include "../src/utils/uiptrtoi_map.h"
 #include "../src/utils/stoi_map.h"
 #include "../src/utils/vector.h"
-#include "../src/utils/set.h"
+#include "../src/utils/sparse_map.h"
+#include "../src/utils/mpmc_ring.h"
+#include "../src/utils/radix_sort.h"
+#include "../src/utils/xor_delta.h"
+#include "../src/utils/block_pool.h"
+#include "../src/utils/scratch_arena.h"
+#include "../src/utils/numa_topology.h"
+#include "../src/utils/worker_pool.h"
+#include <limits.h>
+#include <pthread.h>
 #include <stddef.h>
+#include <time.h>
 
 #include "stdio.h"
 
 //------------------------------------------------------------------------------
 // Macros
 //------------------------------------------------------------------------------
+// Number of consecutive pool slots tracked together
+#define CHUNK_SIZE 64
+
+// Gather and scatter batches are walked in slot order past both sizes, and
+// prefetch that many slots ahead
+#define BATCH_SORT_MIN 1024
+#define BATCH_SORT_BYTES (1 << 20)
+#define BATCH_PREFETCH 8
+
+// Smallest slice handed to a parallel for worker
+#define PARALLEL_MIN_SLICE 4096
+
+// Compaction shrinks vectors holding over that many times their size
+#define COMPACT_SLACK 4
+// Slots moved into place per compaction step of a pool
+#define COMPACT_CHUNK 4096
+
+// Ordered index slot of entities merged into the sorted arrays, entries of
+// entities whose slot is no longer INDEX_SORTED are dropped by the next merge
+#define INDEX_SORTED INT_MAX
+
+// Bound of the spatial cell coordinates
+#define SPATIAL_CELL_LIMIT (1 << 30)
+
+// Flags spatial index entries held in the moved list
+#define SPATIAL_MOVED 0x40000000
+
+// Snapshot blobs: header, entities, recycled ids, per component its array,
+// entities and resource, then the hierarchy entities and sizes
+#define SNAPSHOT_BLOB_COUNT (5 + 3 * ECS_MAX_COMPONENTS)
+#define SNAPSHOT_HIERARCHY_BLOB (3 + 3 * ECS_MAX_COMPONENTS)
 
 //------------------------------------------------------------------------------
 // Typedefs and Enums
@@ -29,16 +74,136 @@ typedef struct
 {
     ecs_entity_t entity;
     ecs_signature_t signature;
+
+    // Disabled entities and components are skipped by queries and systems
+    bool disabled;
+    ecs_signature_t disabled_components;
 } entity_info_t;
 
+// Undo journal of a column during a fork, the pages holding slots below
+// `fork_size` are saved before their first change
+typedef struct
+{
+    bool active;
+    bool failed;
+    int fork_size;
+    vector_t saved_pages;
+    vector_t page_indices;
+    vector_t pages;
+} journal_t;
+
+// Events published during a pass go to rings[current], the ring of the
+// previous pass is still consumed before being cleared at the next flip
+typedef struct
+{
+    mpmc_ring_t rings[2];
+    int current;
+} event_channel_t;
+
 typedef struct
 {
     vector_t array;
+    vector_t entities;
 
-    itoi_map_t entity_to_index_map;
-    itoi_map_t index_to_entity_map;
+    sparse_map_t entity_to_index_map;
+
+    // Scene-level value, stored once instead of on every entity
+    void *resource;
+
+    // Lifecycle hooks, components without hooks are copied and relocated
+    // with memcpy
+    ecs_component_hooks_t hooks;
+
+    // Buffer components only, spilled elements
+    struct buffer_info *buffer;
+
+    // Double buffering, `previous` mirrors the slots of `array` as of the
+    // last flip. Chunks written since are copied back after the flip.
+    bool double_buffered;
+    vector_t previous;
+    vector_t dirty_chunks;
+    uint32_t generation;
+
+    event_channel_t *channel;
+
+    // Number of value indices over the component
+    int index_count;
+
+    journal_t array_journal;
+    journal_t entities_journal;
+    void *fork_resource;
+
+    // Checksum as the sum of the hashes of the chunks. Chunks handed out
+    // for writing are marked stale and hashed again on the next checksum.
+    uint64_t checksum;
+    vector_t chunk_hashes;
+    vector_t stale_chunks;
+
+    // Number of spatial indices over the component, and chunks written
+    // since they were last updated
+    int spatial_count;
+    vector_t moved_chunks;
+
+    // Pool as placed by the last NUMA parallel for, placed again once it
+    // moves, grows or is split between another number of workers
+    void *placed_data;
+    int placed_capacity;
+    int placed_workers;
+
+    // Ordered by ecs_sort_component, compaction leaves the order as is
+    bool key_sorted;
 } component_info_t;
 
+// Slots of buffer components hold a buffer_header_t followed by
+// `inline_capacity` elements. Longer buffers move to a pool block of a
+// power of two elements, `size_class` being its log2 and 0 when inline.
+typedef struct
+{
+    int count;
+    int size_class;
+    size_t block;
+} buffer_header_t;
+
+typedef struct buffer_info
+{
+    size_t element_size;
+    int inline_capacity;
+    block_pool_t pool;
+} buffer_info_t;
+
+typedef struct
+{
+    bool used;
+    int refs;
+
+    ecs_signature_t with;
+    ecs_signature_t without;
+    ecs_signature_t optional;
+
+    // Matching entities, updated on every signature change
+    sparse_map_t entity_to_index_map;
+    vector_t entities;
+    journal_t entities_journal;
+
+    // Bit i of the words is set while entities[i] is enabled, bits past the
+    // list are clear. Batch changes leave the bits stale until the next
+    // iteration rebuilds them.
+    vector_t enabled;
+    bool enabled_stale;
+} query_info_t;
+
+// Filtered list handed out by ecs_world_query_entities, `used` being the
+// scratch memory in use once allocated
+typedef struct
+{
+    uint64_t world;
+    ecs_query_t query;
+    scratch_arena_t *scratch;
+    size_t resets;
+    size_t used;
+    size_t size;
+} query_copy_t;
+
 typedef struct
 {
     ecs_system_t system;
@@ -48,30 +213,240 @@ typedef struct
     ecs_signature_t signature;
     ecs_system_event_t event;
 
-    set_t entities_s;
-    vector_t entities_v;
+    // Resources accessed by the system
+    ecs_signature_t resource_read;
+    ecs_signature_t resource_write;
+
+    // Event channels, producers are planned before consumers
+    ecs_signature_t events_published;
+    ecs_signature_t events_consumed;
+
+    ecs_query_t query;
+
+    // Rate limiting and amortisation
+    ecs_system_config_t config;
+    int slice;
+    ecs_system_stats_t stats;
 } system_info_t;
 
 typedef struct
+{
+    bool used;
+    ecs_signature_t signature;
+    void *values[ECS_MAX_COMPONENTS];
+} prefab_info_t;
+
+typedef struct
+{
+    uint64_t key;
+    ecs_entity_t entity;
+} index_entry_t;
+
+typedef struct
+{
+    uint64_t key;
+    vector_t entities;
+} index_group_t;
+
+typedef struct
+{
+    uint64_t key;
+    int group;
+} index_bucket_t;
+
+typedef struct
+{
+    bool used;
+    ecs_index_kind_t kind;
+    ecs_key_type_t key_type;
+    int component;
+    size_t offset;
+    size_t size;
+
+    // Key of each indexed entity by entity id, and its slot: the position in
+    // its group for hash indices, in `pending` or INDEX_SORTED for ordered ones
+    vector_t entity_keys;
+    sparse_map_t entity_to_slot_map;
+
+    // Hash index, open addressed buckets mapping keys to groups of entities
+    index_bucket_t *buckets;
+    int bucket_capacity;
+    vector_t groups;
+
+    // Ordered index, entities sorted by key. Updates are buffered and merged
+    // by the next lookup.
+    vector_t sorted_keys;
+    vector_t sorted_entities;
+    vector_t pending;
+    int tombstones;
+} index_info_t;
+
+typedef struct
+{
+    ecs_query_t query;
+    bool fusable;
+
+    // Range of the plan systems run by the step, fused when more than one
+    int first;
+    int count;
+} plan_step_t;
+
+typedef struct
+{
+    vector_t steps;
+    vector_t systems;
+} plan_t;
+
+typedef struct
+{
+    ecs_entity_t entity;
+    float position[3];
+} spatial_entry_t;
+
+typedef struct
+{
+    bool used;
+    int component;
+    size_t offset;
+    int dims;
+    float cell_size;
+    int threads;
+
+    // Entries counting sorted by cell hash, the entries of hash h are
+    // [cell_starts[h], cell_starts[h + 1]). Removed entries keep entity 0.
+    int cell_mask;
+    vector_t cell_starts;
+    vector_t entries;
+    int tombstones;
+
+    // Entries changing cell since the last rebuild, scanned by every query
+    vector_t moved;
+
+    // Entry of each entity, flagged by SPATIAL_MOVED when in `moved`
+    sparse_map_t entity_to_entry_map;
+    bool stale;
+
+    vector_t results;
+} spatial_index_t;
+
+typedef struct
+{
+    // Depth-first order, every node followed by its `sizes[i] - 1`
+    // descendants
+    vector_t entities;
+    vector_t sizes;
+
+    sparse_map_t positions;
+    sparse_map_t parents;
+
+    // Position of the parent of every node or -1, rebuilt when stale
+    vector_t parent_indices;
+    bool stale;
+} hierarchy_t;
+
+typedef struct
+{
+    ecs_entity_t next_entities;
+    uint32_t element_sizes[ECS_MAX_COMPONENTS];
+} snapshot_header_t;
+
+typedef struct
+{
+    vector_t blobs[SNAPSHOT_BLOB_COUNT];
+} snapshot_state_t;
+
+typedef struct
+{
+    int capacity;
+    int count;
+    uint64_t first_frame;
+
+    // State of the first frame, and of the last one to encode the next delta
+    snapshot_state_t keyframe;
+    snapshot_state_t latest;
+    snapshot_state_t scratch;
+
+    // Deltas of the following frames, deltas[head] turns the keyframe into
+    // the second frame
+    vector_t *deltas;
+    int head;
+} snapshot_ring_t;
+
+struct ecs_world
 {
     ecs_scene_t scene;
+    // Unique over the process, unlike the address of the world
+    uint64_t uid;
 
     vector_t entities;
     vector_t recycled_entities;
     ecs_entity_t next_entities;
-    itoi_map_t entity_to_index_map;
+    sparse_map_t entity_to_index_map;
+
+    // Lock-free id reservation, recycled ids are taken from the back of
+    // recycled_entities down to recycled_available, then from next_entities.
+    // Reserved ids become entities at the next flush.
+    int recycled_available;
+    ecs_entity_t flushed_next_entities;
+
+    // Bit of each disabled entity or entity with a disabled component,
+    // rebuilt from entity_info_t on restores
+    vector_t inactive_entities;
+    int inactive_count;
 
     component_info_t *components;
     int component_count;
     stoi_map_t component_name_to_index_map;
 
+    vector_t queries;
+    vector_t indices;
+
     vector_t systems;
     uiptrtoi_map_t system_to_index_map;
 
     vector_t on_init_system_indices;
     vector_t on_update_system_indices;
     vector_t on_end_system_indices;
-} scene_info_t;
+    uint64_t passes[ECS_SYSTEM_EVENT_COUNT];
+
+    // Execution plans, rebuilt after the systems change
+    plan_t plans[ECS_SYSTEM_EVENT_COUNT];
+    bool plans_dirty;
+    int fusion_chunk_size;
+
+    vector_t prefabs;
+
+    // Fork point, restored by ecs_restore_scene
+    bool forked;
+    journal_t entities_journal;
+    journal_t recycled_journal;
+    ecs_entity_t fork_next_entities;
+    hierarchy_t *fork_hierarchy;
+
+    snapshot_ring_t *snapshots;
+
+    hierarchy_t hierarchy;
+
+    vector_t spatial_indices;
+
+    // Temporary allocations of the systems, released after each pass
+    scratch_arena_t scratch;
+    // One arena per parallel for worker index, released along
+    vector_t worker_scratch;
+    // Parallel for threads, created on first use
+    worker_pool_t *workers;
+
+    // Parallel for workers pinned per node, pools placed on their nodes
+    bool numa;
+
+    // Next step of the compaction pass, resumed by the next ecs_compact
+    int compact_step;
+    // Pool being ordered by entity id over several steps, -1 when none,
+    // with its ids in their final order and the next slot to fill
+    int compact_pool;
+    vector_t compact_order;
+    int compact_slot;
+};
 
 //------------------------------------------------------------------------------
 // Global Variables
@@ -80,16 +455,84 @@ typedef struct
 //------------------------------------------------------------------------------
 // Static Variables
 //------------------------------------------------------------------------------
+// Scene registry, scene ids index the world pointers (id - 1)
+static pthread_mutex_t scenes_lock = PTHREAD_MUTEX_INITIALIZER;
 static vector_t scenes;
 static vector_t recycled_scene_ids;
 static ecs_scene_t next_scene_id;
-static itoi_map_t scene_to_index_map;
-static scene_info_t *cs = NULL;
+static uint64_t next_world_uid;
+
+// Each thread binds its own scene
+static __thread ecs_world_t *cs = NULL;
+// Arena of the parallel for worker running on the thread, if any
+static __thread scratch_arena_t *worker_scratch = NULL;
+// Node the worker pool thread is pinned to, -1 when unpinned
+static __thread int pinned_node = -1;
+// Last filtered list of a query handed out on the thread
+static __thread query_copy_t query_copy;
+
+// Detected once, read only afterwards
+static pthread_once_t numa_once = PTHREAD_ONCE_INIT;
+static numa_topology_t numa_topology;
 
 //------------------------------------------------------------------------------
 // Function Prototypes
 //------------------------------------------------------------------------------
-static ecs_err_t remove_component_by_index(ecs_entity_t entity, uint8_t index);
+static ecs_err_t remove_component_by_index(ecs_world_t *world, ecs_entity_t entity, uint8_t index, bool destroy);
+static void drop_component_slot(ecs_world_t *world, ecs_entity_t entity, uint8_t index, bool destroy);
+static ecs_err_t delete_entity(ecs_world_t *world, ecs_entity_t entity, bool destroy);
+static ecs_err_t delete_entities(ecs_world_t *world, const ecs_entity_t *entities, int count, bool destroy);
+static void remove_entities(ecs_world_t *world, const ecs_entity_t *entities, int count, bool destroy, uint64_t *keys);
+static void remove_query_entity(query_info_t *query_info, ecs_entity_t entity);
+static ecs_entity_t next_entity_id(ecs_world_t *world);
+static ecs_err_t flush_reserved_entities(ecs_world_t *world);
+static ecs_err_t reserve_query_membership(ecs_world_t *world, ecs_entity_t entity, ecs_signature_t signature);
+static void update_query_membership(ecs_world_t *world, ecs_entity_t entity, ecs_signature_t signature, bool alive);
+static query_info_t *get_query_info(ecs_world_t *world, ecs_query_t query);
+static inline bool query_matches(query_info_t *query_info, ecs_signature_t signature);
+static void run_system(ecs_world_t *world, system_info_t *sys_info, query_info_t *query_info, int first, int end);
+static void schedule_system(ecs_world_t *world, system_info_t *sys_info, uint64_t pass);
+static void mark_chunk_dirty(component_info_t *comp_info, int index);
+static ecs_err_t reserve_stale_chunks(component_info_t *comp_info, int slots);
+static void mark_chunks_stale(component_info_t *comp_info, int first, int count);
+static void begin_previous_write(component_info_t *comp_info);
+static void end_previous_write(component_info_t *comp_info);
+static void sync_previous_slots(component_info_t *comp_info, int first);
+static void flip_component_buffers(component_info_t *comp_info);
+static ecs_err_t pool_reserve(component_info_t *comp_info, int capacity);
+static ecs_err_t add_component_slot(ecs_world_t *world, ecs_entity_t entity, const char *name, void **slot);
+static void destroy_components(component_info_t *comp_info);
+static void free_event_channel(component_info_t *comp_info);
+static void flip_event_channel(event_channel_t *channel);
+static uint64_t encode_key(ecs_key_type_t type, size_t size, const void *value);
+static ecs_err_t reorder_pool(ecs_world_t *world, int comp_info_ind, const uint32_t *order, ecs_entity_t *tmp);
+static ecs_err_t index_components(ecs_world_t *world, int component, int first, int count);
+static void unindex_component(ecs_world_t *world, int component, ecs_entity_t entity);
+static void free_index(ecs_world_t *world, index_info_t *index_info);
+static void journal_write(journal_t *journal, vector_t *column, int first, int count);
+static void journal_stop(journal_t *journal);
+static void populate_query(ecs_world_t *world, query_info_t *query_info);
+static void init_hierarchy(hierarchy_t *hierarchy);
+static void free_hierarchy(hierarchy_t *hierarchy);
+static ecs_err_t rebuild_hierarchy_maps(hierarchy_t *hierarchy);
+static ecs_err_t delete_subtree(ecs_world_t *world, int pos);
+static void unindex_spatial(ecs_world_t *world, int component, ecs_entity_t entity);
+static void free_spatial_index(ecs_world_t *world, spatial_index_t *spatial);
+static void invalidate_spatial_indices(ecs_world_t *world);
+static void free_buffer_info(component_info_t *comp_info);
+static void release_buffer(component_info_t *comp_info, void *comp);
+static ecs_err_t update_inactive_bit(ecs_world_t *world, const entity_info_t *entity_info);
+static ecs_err_t rebuild_inactive_entities(ecs_world_t *world);
+static bool is_inactive_member(ecs_world_t *world, query_info_t *query_info, ecs_entity_t entity);
+static void update_enabled_bits(ecs_world_t *world, const entity_info_t *entity_info);
+static void set_enabled_bit(query_info_t *query_info, int ind, bool enabled);
+static ecs_err_t rebuild_enabled_bits(ecs_world_t *world, query_info_t *query_info);
+static int next_enabled_run(query_info_t *query_info, int from, int end, int *count);
+static worker_pool_t *get_worker_pool(ecs_world_t *world);
+static scratch_arena_t *get_scratch(ecs_world_t *world);
+static vector_t *get_event_system_indices(ecs_world_t *world, ecs_system_event_t event);
+static ecs_err_t build_plan(ecs_world_t *world, ecs_system_event_t event);
+static void run_fused_systems(ecs_world_t *world, system_info_t **systems, int system_count, ecs_query_t query);
 
 //------------------------------------------------------------------------------
 // Function Implementations
@@ -98,9 +541,8 @@ ecs_err_t ecs_init()
 {
     cs = NULL;
     next_scene_id = 1;
-    vector_init(&scenes, sizeof(scene_info_t), 1);
+    vector_init(&scenes, sizeof(ecs_world_t *), 1);
     vector_init(&recycled_scene_ids, sizeof(ecs_scene_t), 1);
-    itoi_map_init(&scene_to_index_map);
 
     return ECS_OK;
 }
@@ -109,125 +551,277 @@ ecs_err_t ecs_terminate()
 {
     for (int i = 0; i < scenes.size; ++i)
     {
-        vector_get(&scenes, i, (void **)&cs);
-        ecs_free_scene();
+        ecs_world_t *world = ((ecs_world_t **)scenes.data)[i];
+        if (world != NULL)
+        {
+            ecs_world_free(world);
+        }
     }
 
+    vector_free(&scenes);
+    vector_free(&recycled_scene_ids);
+    cs = NULL;
+
     return ECS_OK;
 }
 
-ecs_err_t ecs_create_scene(ecs_scene_t *scene)
+ecs_err_t ecs_world_create(ecs_world_t **world)
 {
     ecs_err_t ret = ECS_OK;
-    scene_info_t nscene = { 0 };
-    if (recycled_scene_ids.size > 0)
-    {
-        vector_get_copy(&recycled_scene_ids, 0, &nscene.scene);
-        vector_remove(&recycled_scene_ids, 0);
-    }
-    else
+    ecs_world_t *nworld = calloc(1, sizeof(ecs_world_t));
+    if (nworld == NULL)
     {
-        nscene.scene = next_scene_id++;
+        return ECS_ERR_MEM;
     }
+    nworld->uid = __atomic_add_fetch(&next_world_uid, 1, __ATOMIC_RELAXED);
 
-    nscene.components = calloc(ECS_MAX_COMPONENTS, sizeof(*nscene.components) * ECS_MAX_COMPONENTS);
+    nworld->components = calloc(ECS_MAX_COMPONENTS, sizeof(*nworld->components));
 
-    nscene.next_entities = 1;
-    ret |= nscene.components == NULL;
-    ret |= vector_init(&nscene.entities, sizeof(entity_info_t), 1);
-    ret |= vector_init(&nscene.recycled_entities, sizeof(ecs_entity_t), 1);
+    nworld->next_entities = 1;
+    nworld->flushed_next_entities = 1;
+    ret |= nworld->components == NULL;
+    ret |= vector_init(&nworld->entities, sizeof(entity_info_t), 1);
+    ret |= vector_init(&nworld->recycled_entities, sizeof(ecs_entity_t), 1);
+    ret |= vector_init(&nworld->inactive_entities, sizeof(uint64_t), 0);
 
-    ret |= vector_init(&nscene.systems, sizeof(system_info_t), 1);
-    ret |= vector_init(&nscene.on_init_system_indices, sizeof(int), 1);
-    ret |= vector_init(&nscene.on_update_system_indices, sizeof(int), 1);
-    ret |= vector_init(&nscene.on_end_system_indices, sizeof(int), 1);
+    ret |= vector_init(&nworld->queries, sizeof(query_info_t), 0);
+    ret |= vector_init(&nworld->indices, sizeof(index_info_t), 0);
+    ret |= vector_init(&nworld->spatial_indices, sizeof(spatial_index_t), 0);
+    scratch_arena_init(&nworld->scratch);
+    ret |= vector_init(&nworld->worker_scratch, sizeof(scratch_arena_t), 0);
+    nworld->compact_pool = -1;
+    ret |= vector_init(&nworld->compact_order, sizeof(ecs_entity_t), 0);
+    ret |= vector_init(&nworld->systems, sizeof(system_info_t), 1);
+    ret |= vector_init(&nworld->on_init_system_indices, sizeof(int), 1);
+    ret |= vector_init(&nworld->on_update_system_indices, sizeof(int), 1);
+    ret |= vector_init(&nworld->on_end_system_indices, sizeof(int), 1);
+    ret |= vector_init(&nworld->prefabs, sizeof(prefab_info_t), 0);
+    for (int i = 0; i < ECS_SYSTEM_EVENT_COUNT; ++i)
+    {
+        ret |= vector_init(&nworld->plans[i].steps, sizeof(plan_step_t), 0);
+        ret |= vector_init(&nworld->plans[i].systems, sizeof(system_info_t *), 0);
+    }
+    nworld->plans_dirty = true;
     if (ret != ECS_OK)
     {
         return ECS_ERR_MEM;
     }
 
-    stoi_map_init(&nscene.component_name_to_index_map);
-    uiptrtoi_map_init(&nscene.system_to_index_map);
-    itoi_map_init(&nscene.entity_to_index_map);
+    stoi_map_init(&nworld->component_name_to_index_map);
+    uiptrtoi_map_init(&nworld->system_to_index_map);
+    sparse_map_init(&nworld->entity_to_index_map);
+    init_hierarchy(&nworld->hierarchy);
 
-    vector_push_back(&scenes, &nscene);
-    itoi_map_insert(&scene_to_index_map, nscene.scene, scenes.size - 1);
-    *scene = nscene.scene;
+    *world = nworld;
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_free_scene()
+uint64_t ecs_world_get_uid(ecs_world_t *world)
+{
+    return world->uid;
+}
+
+ecs_err_t ecs_world_free(ecs_world_t *world)
 {
-    vector_free(&cs->entities);
-    vector_free(&cs->recycled_entities);
+    vector_free(&world->entities);
+    vector_free(&world->recycled_entities);
+    vector_free(&world->inactive_entities);
+    journal_stop(&world->entities_journal);
+    journal_stop(&world->recycled_journal);
+    ecs_world_set_snapshot_capacity(world, 0);
+    free_hierarchy(&world->hierarchy);
+
+    // Prefab values are destroyed with the component hooks
+    for (int i = 0; i < world->prefabs.size; ++i)
+    {
+        ecs_world_free_prefab(world, i + 1);
+    }
+    vector_free(&world->prefabs);
 
     for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
     {
-        vector_free(&cs->components[i].array);
-        itoi_map_destroy(&cs->components[i].entity_to_index_map);
-        itoi_map_destroy(&cs->components[i].index_to_entity_map);
+        destroy_components(&world->components[i]);
+        vector_free(&world->components[i].array);
+        vector_free(&world->components[i].entities);
+        sparse_map_destroy(&world->components[i].entity_to_index_map);
+        free(world->components[i].resource);
+        vector_free(&world->components[i].previous);
+        vector_free(&world->components[i].dirty_chunks);
+        free_event_channel(&world->components[i]);
+        free_buffer_info(&world->components[i]);
+        journal_stop(&world->components[i].array_journal);
+        journal_stop(&world->components[i].entities_journal);
+        free(world->components[i].fork_resource);
+        vector_free(&world->components[i].chunk_hashes);
+        vector_free(&world->components[i].stale_chunks);
+        vector_free(&world->components[i].moved_chunks);
     }
-    free(cs->components);
-    cs->components = NULL;
+    free(world->components);
+    world->components = NULL;
 
-    for (int i = 0; i < cs->systems.size; ++i)
+    for (int i = 0; i < world->systems.size; ++i)
     {
         system_info_t *sys;
-        vector_get(&cs->systems, i, (void **)&sys);
-        vector_free(&sys->entities_v);
-        set_free(&sys->entities_s);
-    }
-    vector_free(&cs->systems);
-    vector_free(&cs->on_init_system_indices);
-    vector_free(&cs->on_update_system_indices);
-    vector_free(&cs->on_end_system_indices);
-
-    stoi_map_destroy(&cs->component_name_to_index_map);
-    uiptrtoi_map_destroy(&cs->system_to_index_map);
-    itoi_map_destroy(&cs->entity_to_index_map);
-
-    int del_scene_id;
-    itoi_map_get(&scene_to_index_map, cs->scene, &del_scene_id);
-    itoi_map_remove(&scene_to_index_map, cs->scene);
-    vector_remove(&scenes, del_scene_id);
-    vector_push_back(&recycled_scene_ids, &cs->scene);
-    cs = NULL;
+        vector_get(&world->systems, i, (void **)&sys);
+        free(sys->args);
+    }
+    vector_free(&world->systems);
+
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        vector_free(&query_info->entities);
+        vector_free(&query_info->enabled);
+        sparse_map_destroy(&query_info->entity_to_index_map);
+        journal_stop(&query_info->entities_journal);
+    }
+    vector_free(&world->queries);
+
+    for (int i = 0; i < world->indices.size; ++i)
+    {
+        index_info_t *index_info;
+        vector_get(&world->indices, i, (void **)&index_info);
+        free_index(world, index_info);
+    }
+    vector_free(&world->indices);
+
+    for (int i = 0; i < world->spatial_indices.size; ++i)
+    {
+        spatial_index_t *spatial;
+        vector_get(&world->spatial_indices, i, (void **)&spatial);
+        free_spatial_index(world, spatial);
+    }
+    vector_free(&world->spatial_indices);
+    scratch_arena_destroy(&world->scratch);
+    for (int i = 0; i < world->worker_scratch.size; ++i)
+    {
+        scratch_arena_destroy((scratch_arena_t *)world->worker_scratch.data + i);
+    }
+    vector_free(&world->worker_scratch);
+    vector_free(&world->compact_order);
+    if (world->workers)
+    {
+        worker_pool_destroy(world->workers);
+        free(world->workers);
+    }
+
+    vector_free(&world->on_init_system_indices);
+    vector_free(&world->on_update_system_indices);
+    vector_free(&world->on_end_system_indices);
+    for (int i = 0; i < ECS_SYSTEM_EVENT_COUNT; ++i)
+    {
+        vector_free(&world->plans[i].steps);
+        vector_free(&world->plans[i].systems);
+    }
+
+    stoi_map_destroy(&world->component_name_to_index_map);
+    uiptrtoi_map_destroy(&world->system_to_index_map);
+    sparse_map_destroy(&world->entity_to_index_map);
+
+    // Release the scene id of registered worlds
+    if (world->scene != 0)
+    {
+        pthread_mutex_lock(&scenes_lock);
+        ((ecs_world_t **)scenes.data)[world->scene - 1] = NULL;
+        vector_push_back(&recycled_scene_ids, &world->scene);
+        pthread_mutex_unlock(&scenes_lock);
+    }
+
+    if (cs == world)
+    {
+        cs = NULL;
+    }
+    free(world);
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_bind_scene(ecs_scene_t scene)
+ecs_err_t ecs_create_scene(ecs_scene_t *scene)
 {
-    int ind;
-    if (!itoi_map_get(&scene_to_index_map, scene, &ind))
+    ecs_world_t *world;
+    if (ecs_world_create(&world) != ECS_OK)
     {
-        cs = NULL;
-        return ECS_ERR_NULL;
+        return ECS_ERR_MEM;
+    }
+
+    pthread_mutex_lock(&scenes_lock);
+    if (recycled_scene_ids.size > 0)
+    {
+        vector_get_copy(&recycled_scene_ids, recycled_scene_ids.size - 1, &world->scene);
+        --recycled_scene_ids.size;
+    }
+    else if (vector_push_back(&scenes, &(ecs_world_t *){ NULL }) == 0)
+    {
+        world->scene = next_scene_id++;
+    }
+    if (world->scene != 0)
+    {
+        ((ecs_world_t **)scenes.data)[world->scene - 1] = world;
+    }
+    pthread_mutex_unlock(&scenes_lock);
+
+    if (world->scene == 0)
+    {
+        ecs_world_free(world);
+        return ECS_ERR_MEM;
     }
 
-    vector_get(&scenes, ind, (void **)&cs);
+    *scene = world->scene;
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_register_component_by_name(const char *name, size_t size)
+ecs_err_t ecs_free_scene()
+{
+    if (cs == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    return ecs_world_free(cs);
+}
+
+ecs_err_t ecs_bind_scene(ecs_scene_t scene)
+{
+    return ecs_get_scene_world(scene, &cs);
+}
+
+ecs_err_t ecs_get_scene_world(ecs_scene_t scene, ecs_world_t **world)
+{
+    pthread_mutex_lock(&scenes_lock);
+    *world = scene > 0 && scene <= scenes.size ? ((ecs_world_t **)scenes.data)[scene - 1] : NULL;
+    pthread_mutex_unlock(&scenes_lock);
+
+    return *world != NULL ? ECS_OK : ECS_ERR_NULL;
+}
+
+ecs_world_t *ecs_get_world()
+{
+    return cs;
+}
+
+ecs_err_t ecs_world_register_component_by_name(ecs_world_t *world, const char *name, size_t size)
 {
-    if (stoi_map_get(&cs->component_name_to_index_map, name, NULL))
+    if (stoi_map_get(&world->component_name_to_index_map, name, NULL))
     {
         return ECS_ERR_EXISTS;
     }
 
     for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
     {
-        if (cs->components[i].array.element_size == 0)
+        if (world->components[i].array.element_size == 0)
         {
-            stoi_map_insert(&cs->component_name_to_index_map, name, i);
-            cs->components[i].array.element_size = size;
+            stoi_map_insert(&world->component_name_to_index_map, name, i);
+            world->components[i].array.element_size = size;
 
-            vector_init(&cs->components[i].array, size, 1);
-            itoi_map_init(&cs->components[i].entity_to_index_map);
-            itoi_map_init(&cs->components[i].index_to_entity_map);
+            vector_init(&world->components[i].array, size, 1);
+            vector_init(&world->components[i].entities, sizeof(ecs_entity_t), 1);
+            vector_init(&world->components[i].chunk_hashes, sizeof(uint64_t), 0);
+            vector_init(&world->components[i].stale_chunks, sizeof(uint64_t), 0);
+            vector_init(&world->components[i].moved_chunks, sizeof(uint64_t), 0);
+            sparse_map_init(&world->components[i].entity_to_index_map);
             return ECS_OK;
         }
     }
@@ -235,422 +829,6938 @@ ecs_err_t ecs_register_component_by_name(const char *name, size_t size)
     return ECS_ERR_MEM;
 }
 
-ecs_err_t ecs_unregister_component_by_name(const char *name)
+ecs_err_t ecs_world_unregister_component_by_name(ecs_world_t *world, const char *name)
 {
     int comp_info_ind;
-    if (!stoi_map_get(&cs->component_name_to_index_map, name, &comp_info_ind))
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
     {
         return ECS_ERR_NULL;
     }
+    if (world->forked)
+    {
+        return ECS_ERR;
+    }
 
-    component_info_t *comp_info = &cs->components[comp_info_ind];
+    component_info_t *comp_info = &world->components[comp_info_ind];
 
+    destroy_components(comp_info);
     vector_free(&comp_info->array);
-    itoi_map_destroy(&comp_info->entity_to_index_map);
-    itoi_map_destroy(&comp_info->index_to_entity_map);
-
-    // TODO: edit mapping for the last component type
+    vector_free(&comp_info->entities);
+    vector_free(&comp_info->previous);
+    vector_free(&comp_info->dirty_chunks);
+    comp_info->double_buffered = false;
+    vector_free(&comp_info->chunk_hashes);
+    vector_free(&comp_info->stale_chunks);
+    comp_info->checksum = 0;
+    sparse_map_destroy(&comp_info->entity_to_index_map);
+    free(comp_info->resource);
+    comp_info->resource = NULL;
+    comp_info->hooks = (ecs_component_hooks_t){ 0 };
+    comp_info->placed_data = NULL;
+    comp_info->key_sorted = false;
+    if (world->compact_pool == comp_info_ind)
+    {
+        world->compact_pool = -1;
+    }
+    free_event_channel(comp_info);
+    free_buffer_info(comp_info);
 
+    for (int i = 0; i < world->indices.size; ++i)
+    {
+        index_info_t *index_info;
+        vector_get(&world->indices, i, (void **)&index_info);
+        if (index_info->used && index_info->component == comp_info_ind)
+        {
+            free_index(world, index_info);
+        }
+    }
+    for (int i = 0; i < world->spatial_indices.size; ++i)
+    {
+        spatial_index_t *spatial;
+        vector_get(&world->spatial_indices, i, (void **)&spatial);
+        if (spatial->used && spatial->component == comp_info_ind)
+        {
+            free_spatial_index(world, spatial);
+        }
+    }
+    vector_free(&comp_info->moved_chunks);
 
-    stoi_map_remove(&cs->component_name_to_index_map, name);
+    // Ids are slots, not a dense range, so no other component moves. The
+    // emptied slot is taken by the next registration.
+    stoi_map_remove(&world->component_name_to_index_map, name);
 
     // Remove the component from all entities
-    for (int i = 0; i < cs->entities.size; ++i)
+    for (int i = 0; i < world->entities.size; ++i)
     {
         entity_info_t *entity_info;
-        vector_get(&cs->entities, i, (void **)&entity_info);
+        vector_get(&world->entities, i, (void **)&entity_info);
 
         entity_info->signature &= ~(1 << comp_info_ind);
+        entity_info->disabled_components &= ~(1 << comp_info_ind);
+        update_inactive_bit(world, entity_info);
+        update_query_membership(world, entity_info->entity, entity_info->signature, true);
     }
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_create_entity(ecs_entity_t *entity)
+ecs_entity_t next_entity_id(ecs_world_t *world)
 {
-    entity_info_t nentity = {  };
-    if (cs->recycled_entities.size > 0)
+    // Only called once reserved ids are flushed
+    ecs_entity_t entity;
+    if (world->recycled_entities.size > 0)
     {
-        vector_get_copy(&cs->recycled_entities, 0, &nentity.entity);
-        vector_remove(&cs->recycled_entities, 0);
+        vector_get_copy(&world->recycled_entities, world->recycled_entities.size - 1, &entity);
+        --world->recycled_entities.size;
     }
     else
     {
-        nentity.entity = cs->next_entities++;
+        entity = world->next_entities++;
     }
+    world->recycled_available = world->recycled_entities.size;
+    world->flushed_next_entities = world->next_entities;
 
-    vector_push_back(&cs->entities, &nentity);
-    itoi_map_insert(&cs->entity_to_index_map, nentity.entity, cs->entities.size - 1);
-    *entity = nentity.entity;
+    return entity;
+}
 
-    return ECS_OK;
+static inline bool has_reserved_entities(ecs_world_t *world)
+{
+    return __atomic_load_n(&world->recycled_available, __ATOMIC_ACQUIRE) != world->recycled_entities.size ||
+        __atomic_load_n(&world->next_entities, __ATOMIC_ACQUIRE) != world->flushed_next_entities;
 }
 
-ecs_err_t ecs_delete_entity(ecs_entity_t entity)
+ecs_err_t flush_reserved_entities(ecs_world_t *world)
 {
-    int del_entity_ind, last_entity_ind;
-    if (!itoi_map_get(&cs->entity_to_index_map, entity, &del_entity_ind))
+    if (!has_reserved_entities(world))
     {
-        return ECS_ERR_NULL;
+        return ECS_OK;
     }
 
-    last_entity_ind = cs->entities.size - 1;
-
-    entity_info_t *del_entity_info, *last_entity_info;
-    vector_get(&cs->entities, del_entity_ind, (void **)&del_entity_info);
+    int recycled_available = world->recycled_available > 0 ? world->recycled_available : 0;
+    int count = (world->recycled_entities.size - recycled_available) + (world->next_entities - world->flushed_next_entities);
+    int first_entity_ind = world->entities.size;
+    if (vector_reserve_size(&world->entities, first_entity_ind + count) ||
+            sparse_map_reserve(&world->entity_to_index_map, world->next_entities - 1))
+    {
+        return ECS_ERR_MEM;
+    }
 
-    // Remove all components from entity
-    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i) 
+    // New entities join the queries requiring no component
+    for (int i = 0; i < world->queries.size; ++i)
     {
-        if (del_entity_info->signature & (1 << i))
+        query_info_t *query_info = (query_info_t *)world->queries.data + i;
+        if (query_info->used && query_matches(query_info, 0) &&
+                (vector_reserve_size(&query_info->entities, query_info->entities.size + count) ||
+                 sparse_map_reserve(&query_info->entity_to_index_map, world->next_entities - 1)))
         {
-            remove_component_by_index(entity, i);
+            return ECS_ERR_MEM;
         }
     }
+    world->entities.size = first_entity_ind + count;
+    journal_write(&world->entities_journal, &world->entities, first_entity_ind, count);
 
-    if (del_entity_ind != last_entity_ind)
+    entity_info_t *entity_info = (entity_info_t *)world->entities.data + first_entity_ind;
+    for (int i = recycled_available; i < world->recycled_entities.size; ++i, ++entity_info)
     {
-        vector_get(&cs->entities, last_entity_ind, (void **)&last_entity_info);
-        memcpy(del_entity_info, last_entity_info, sizeof(entity_info_t));
-        itoi_map_insert(&cs->entity_to_index_map, last_entity_info->entity, del_entity_ind);
+        vector_get_copy(&world->recycled_entities, i, &entity_info->entity);
+    }
+    for (ecs_entity_t entity = world->flushed_next_entities; entity < world->next_entities; ++entity, ++entity_info)
+    {
+        entity_info->entity = entity;
+    }
+
+    entity_info = (entity_info_t *)world->entities.data + first_entity_ind;
+    for (int i = 0; i < count; ++i)
+    {
+        entity_info[i] = (entity_info_t){ .entity=entity_info[i].entity };
+        sparse_map_insert(&world->entity_to_index_map, entity_info[i].entity, first_entity_ind + i);
+        update_query_membership(world, entity_info[i].entity, 0, true);
     }
 
-    vector_remove(&cs->entities, last_entity_ind);
-    itoi_map_remove(&cs->entity_to_index_map, entity);
-    vector_push_back(&cs->recycled_entities, &entity);
+    world->recycled_entities.size = recycled_available;
+    world->recycled_available = recycled_available;
+    world->flushed_next_entities = world->next_entities;
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_add_component_by_name(ecs_entity_t entity, const char *name, void *default_value)
+ecs_err_t ecs_world_reserve_entity_ids(ecs_world_t *world, int count, ecs_entity_t *entities)
 {
-    int entity_ind, comp_info_ind;
-    if (!itoi_map_get(&cs->entity_to_index_map, entity, &entity_ind) || 
-            !stoi_map_get(&cs->component_name_to_index_map, name, &comp_info_ind)) 
+    if (count <= 0)
     {
-        return ECS_ERR_NULL;
+        return count == 0 ? ECS_OK : ECS_ERR_NULL;
     }
 
-    // Check if entity already has the component
-    component_info_t *comp_info = &cs->components[comp_info_ind];
-    if (itoi_map_get(&comp_info->entity_to_index_map, entity, NULL))
+    // Claim recycled slots [first, first + count), negative slots are new ids
+    int first = __atomic_sub_fetch(&world->recycled_available, count, __ATOMIC_ACQ_REL);
+    int recycled = first >= 0 ? count : (first + count > 0 ? first + count : 0);
+    for (int i = 0; i < recycled; ++i)
     {
-        return ECS_ERR_EXISTS;
+        vector_get_copy(&world->recycled_entities, first + count - 1 - i, &entities[i]);
     }
 
-    entity_info_t *entity_info;
-    vector_get(&cs->entities, entity_ind, (void **)&entity_info);
-
-    // Set default value or empty value
-    if (default_value)
-    {
-        vector_push_back(&comp_info->array, default_value);
-    }
-    else
+    if (recycled < count)
     {
-        void *empty_comp = calloc(1, comp_info->array.element_size);
-        if (empty_comp == NULL)
+        ecs_entity_t entity = __atomic_fetch_add(&world->next_entities, count - recycled, __ATOMIC_ACQ_REL);
+        for (int i = recycled; i < count; ++i)
         {
-            return ECS_ERR_MEM;
+            entities[i] = entity++;
         }
-        vector_push_back(&comp_info->array, empty_comp);
-        free(empty_comp);
     }
 
-    // Append to the mapping
-    itoi_map_insert(&comp_info->entity_to_index_map, entity, comp_info->array.size - 1);
-    itoi_map_insert(&comp_info->index_to_entity_map, comp_info->array.size - 1, entity);
+    return ECS_OK;
+}
 
-    entity_info->signature |= (1 << comp_info_ind);
+ecs_err_t ecs_world_flush_entities(ecs_world_t *world)
+{
+    return flush_reserved_entities(world);
+}
 
-    // Add entity to the corresponding systems
-    for (int i = 0; i < cs->systems.size; ++i)
+ecs_err_t ecs_world_create_entity(ecs_world_t *world, ecs_entity_t *entity)
+{
+    // Room for a new id is made before one is taken, no id exceeds
+    // next_entities
+    if (flush_reserved_entities(world) != ECS_OK || vector_reserve_size(&world->entities, world->entities.size + 1) ||
+            sparse_map_reserve(&world->entity_to_index_map, world->next_entities) ||
+            reserve_query_membership(world, world->next_entities, 0) != ECS_OK)
     {
-        system_info_t *sys_info;
-        vector_get(&cs->systems, i, (void **)&sys_info);
-        if ((sys_info->signature & entity_info->signature) == sys_info->signature)
-        {
-            if (!set_contains(&sys_info->entities_s, entity))
-            {
-                vector_push_back(&sys_info->entities_v, &entity);
-                set_insert(&sys_info->entities_s, entity);
-            }
-        }
+        return ECS_ERR_MEM;
     }
 
+    entity_info_t nentity = { .entity=next_entity_id(world) };
+
+    journal_write(&world->entities_journal, &world->entities, world->entities.size, 1);
+    vector_push_back(&world->entities, &nentity);
+    sparse_map_insert(&world->entity_to_index_map, nentity.entity, world->entities.size - 1);
+    update_query_membership(world, nentity.entity, 0, true);
+    *entity = nentity.entity;
+
     return ECS_OK;
 }
 
-ecs_err_t remove_component_by_index(ecs_entity_t entity, uint8_t index)
+ecs_err_t ecs_world_delete_entity(ecs_world_t *world, ecs_entity_t entity)
 {
-    int entity_ind;
-    if (!itoi_map_get(&cs->entity_to_index_map, entity, &entity_ind))
+    return delete_entity(world, entity, true);
+}
+
+ecs_err_t delete_entity(ecs_world_t *world, ecs_entity_t entity, bool destroy)
+{
+    int del_entity_ind, last_entity_ind;
+    if (flush_reserved_entities(world) != ECS_OK || !sparse_map_get(&world->entity_to_index_map, entity, &del_entity_ind))
     {
         return ECS_ERR_NULL;
     }
 
-    entity_info_t *entity_info;
-    vector_get(&cs->entities, entity_ind, (void **)&entity_info);
+    // Descendants are deleted along
+    int node_ind;
+    if (sparse_map_get(&world->hierarchy.positions, entity, &node_ind))
+    {
+        if (delete_subtree(world, node_ind) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+        sparse_map_get(&world->entity_to_index_map, entity, &del_entity_ind);
+    }
 
-    // Check if entity has the component
-    if (!(entity_info->signature & (1 << index)))
+    last_entity_ind = world->entities.size - 1;
+
+    entity_info_t *del_entity_info, *last_entity_info;
+    vector_get(&world->entities, del_entity_ind, (void **)&del_entity_info);
+
+    // Remove all components from entity, then the entity from every query
+    // holding it
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i) 
     {
-        return ECS_ERR_NULL;
+        if (del_entity_info->signature & (1 << i))
+        {
+            drop_component_slot(world, entity, i, destroy);
+        }
     }
+    update_query_membership(world, entity, 0, false);
 
-    // Remove component from component array
-    // Step 1 - get del comp ind and last comp ind
-    component_info_t *comp_info = &cs->components[index];
-    int del_comp_ind, last_comp_ind;
-    itoi_map_get(&comp_info->entity_to_index_map, entity, &del_comp_ind);
-    last_comp_ind = comp_info->array.size - 1;
+    journal_write(&world->entities_journal, &world->entities, del_entity_ind, 1);
+    journal_write(&world->entities_journal, &world->entities, last_entity_ind, 1);
+    del_entity_info->disabled = false;
+    del_entity_info->disabled_components = 0;
+    update_inactive_bit(world, del_entity_info);
+    if (del_entity_ind != last_entity_ind)
+    {
+        vector_get(&world->entities, last_entity_ind, (void **)&last_entity_info);
+        memcpy(del_entity_info, last_entity_info, sizeof(entity_info_t));
+        sparse_map_insert(&world->entity_to_index_map, last_entity_info->entity, del_entity_ind);
+    }
 
-    // Only perform shift if necessary
-    int last_entity;
-    if (del_comp_ind != last_comp_ind)
+    vector_remove(&world->entities, last_entity_ind);
+    sparse_map_remove(&world->entity_to_index_map, entity);
+    journal_write(&world->recycled_journal, &world->recycled_entities, world->recycled_entities.size, 1);
+    vector_push_back(&world->recycled_entities, &entity);
+    world->recycled_available = world->recycled_entities.size;
+
+    return ECS_OK;
+}
+
+static int compare_slots_descending(const void *a, const void *b)
+{
+    uint64_t ka = *(const uint64_t *)a, kb = *(const uint64_t *)b;
+
+    return (ka < kb) - (ka > kb);
+}
+
+// Deletes distinct live entities outside the hierarchy in one pass over
+// each pool, query and the entity array. Fails before anything changes.
+ecs_err_t delete_entities(ecs_world_t *world, const ecs_entity_t *entities, int count, bool destroy)
+{
+    if (count == 0)
     {
-        void *del_comp, *last_comp;
-        vector_get(&comp_info->array, del_comp_ind, &del_comp);
-        vector_get(&comp_info->array, last_comp_ind, &last_comp);
-        memcpy(del_comp, last_comp, comp_info->array.element_size);
+        return ECS_OK;
+    }
 
-        // Update mappings
-        itoi_map_get(&comp_info->index_to_entity_map, last_comp_ind, &last_entity);
-        itoi_map_insert(&comp_info->entity_to_index_map, last_entity, del_comp_ind);
-        itoi_map_insert(&comp_info->index_to_entity_map, del_comp_ind, last_entity);
+    uint64_t *keys = malloc(count * sizeof(uint64_t));
+    if (keys == NULL || vector_reserve_size(&world->recycled_entities, world->recycled_entities.size + count))
+    {
+        free(keys);
+        return ECS_ERR_MEM;
     }
+    remove_entities(world, entities, count, destroy, keys);
+    free(keys);
 
-    // Remove last component and entity mapping
-    vector_remove(&comp_info->array, last_comp_ind);
-    itoi_map_remove(&comp_info->index_to_entity_map, last_comp_ind);
-    itoi_map_remove(&comp_info->entity_to_index_map, entity);
+    return ECS_OK;
+}
+
+// Body of delete_entities, with the recycled ids reserved and room for
+// `count` keys: a slot in the high half, a batch position in the low one.
+// Holes are filled from the back in descending slot order, so the filler
+// is never part of the batch.
+void remove_entities(ecs_world_t *world, const ecs_entity_t *entities, int count, bool destroy, uint64_t *keys)
+{
+    ecs_signature_t used = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        int entity_ind;
+        sparse_map_get(&world->entity_to_index_map, entities[i], &entity_ind);
+        keys[i] = (uint64_t)entity_ind << 32 | (uint32_t)i;
+        used |= ((entity_info_t *)world->entities.data)[entity_ind].signature;
+    }
+
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (!(used & (1 << i)))
+        {
+            continue;
+        }
+
+        int n = 0;
+        for (int j = 0; j < count; ++j)
+        {
+            int slot;
+            if (sparse_map_get(&world->components[i].entity_to_index_map, entities[j], &slot))
+            {
+                keys[n++] = (uint64_t)slot << 32 | (uint32_t)j;
+            }
+        }
+        qsort(keys, n, sizeof(uint64_t), compare_slots_descending);
+        for (int j = 0; j < n; ++j)
+        {
+            drop_component_slot(world, entities[(uint32_t)keys[j]], i, destroy);
+        }
+    }
 
-    // Remove entity from the corresponding system
-    for (int i = 0; i < cs->systems.size; ++i)
+    for (int i = 0; i < world->queries.size; ++i)
     {
-        system_info_t *sys_info;
-        vector_get(&cs->systems, i, (void **)&sys_info);
-        if ((sys_info->signature & entity_info->signature) == sys_info->signature)
+        query_info_t *query_info = (query_info_t *)world->queries.data + i;
+        if (!query_info->used)
+        {
+            continue;
+        }
+
+        int n = 0;
+        for (int j = 0; j < count; ++j)
+        {
+            int slot;
+            if (sparse_map_get(&query_info->entity_to_index_map, entities[j], &slot))
+            {
+                keys[n++] = (uint64_t)slot << 32 | (uint32_t)j;
+            }
+        }
+        qsort(keys, n, sizeof(uint64_t), compare_slots_descending);
+        for (int j = 0; j < n; ++j)
         {
-            vector_remove(&sys_info->entities_v, i);
-            set_delete(&sys_info->entities_s, entity);
+            remove_query_entity(query_info, entities[(uint32_t)keys[j]]);
         }
     }
 
-    return ECS_OK;
+    for (int i = 0; i < count; ++i)
+    {
+        int entity_ind;
+        sparse_map_get(&world->entity_to_index_map, entities[i], &entity_ind);
+        keys[i] = (uint64_t)entity_ind << 32 | (uint32_t)i;
+    }
+    qsort(keys, count, sizeof(uint64_t), compare_slots_descending);
+    journal_write(&world->recycled_journal, &world->recycled_entities, world->recycled_entities.size, count);
+    for (int i = 0; i < count; ++i)
+    {
+        int del_entity_ind = keys[i] >> 32, last_entity_ind = world->entities.size - 1;
+        ecs_entity_t entity = entities[(uint32_t)keys[i]];
+        entity_info_t *del_entity_info = (entity_info_t *)world->entities.data + del_entity_ind;
+        journal_write(&world->entities_journal, &world->entities, del_entity_ind, 1);
+        journal_write(&world->entities_journal, &world->entities, last_entity_ind, 1);
+        del_entity_info->disabled = false;
+        del_entity_info->disabled_components = 0;
+        update_inactive_bit(world, del_entity_info);
+        if (del_entity_ind != last_entity_ind)
+        {
+            entity_info_t *last_entity_info = (entity_info_t *)world->entities.data + last_entity_ind;
+            memcpy(del_entity_info, last_entity_info, sizeof(entity_info_t));
+            sparse_map_insert(&world->entity_to_index_map, last_entity_info->entity, del_entity_ind);
+        }
+
+        vector_remove(&world->entities, last_entity_ind);
+        sparse_map_remove(&world->entity_to_index_map, entity);
+        vector_push_back(&world->recycled_entities, &entity);
+    }
+    world->recycled_available = world->recycled_entities.size;
 }
 
-inline ecs_err_t ecs_remove_component_by_name(ecs_entity_t entity, const char *name)
+void init_hierarchy(hierarchy_t *hierarchy)
 {
-    int comp_info_ind;
-    if (!stoi_map_get(&cs->component_name_to_index_map, name, &comp_info_ind)) 
+    vector_init(&hierarchy->entities, sizeof(ecs_entity_t), 0);
+    vector_init(&hierarchy->sizes, sizeof(int), 0);
+    vector_init(&hierarchy->parent_indices, sizeof(int), 0);
+    sparse_map_init(&hierarchy->positions);
+    sparse_map_init(&hierarchy->parents);
+    hierarchy->stale = false;
+}
+
+void free_hierarchy(hierarchy_t *hierarchy)
+{
+    vector_free(&hierarchy->entities);
+    vector_free(&hierarchy->sizes);
+    vector_free(&hierarchy->parent_indices);
+    sparse_map_destroy(&hierarchy->positions);
+    sparse_map_destroy(&hierarchy->parents);
+}
+
+static ecs_err_t update_parent_indices(hierarchy_t *hierarchy)
+{
+    if (!hierarchy->stale)
     {
-        return ECS_ERR_NULL;
+        return ECS_OK;
+    }
+    if (vector_resize(&hierarchy->parent_indices, hierarchy->entities.size))
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // The ancestors still open at a node are chained through their parents
+    int *sizes = hierarchy->sizes.data;
+    int *parent_indices = hierarchy->parent_indices.data;
+    int top = -1;
+    for (int i = 0; i < hierarchy->entities.size; ++i)
+    {
+        while (top >= 0 && i >= top + sizes[top])
+        {
+            top = parent_indices[top];
+        }
+        parent_indices[i] = top;
+        top = i;
     }
+    hierarchy->stale = false;
 
-    return remove_component_by_index(entity, comp_info_ind);
+    return ECS_OK;
 }
 
-ecs_err_t ecs_get_component_by_name(ecs_entity_t entity, const char *name, void **dest)
+ecs_err_t rebuild_hierarchy_maps(hierarchy_t *hierarchy)
 {
-    int entity_ind, comp_info_ind;
-    if (!itoi_map_get(&cs->entity_to_index_map, entity, &entity_ind) || 
-            !stoi_map_get(&cs->component_name_to_index_map, name, &comp_info_ind)) 
+    hierarchy->stale = true;
+    if (update_parent_indices(hierarchy) != ECS_OK)
     {
-        return ECS_ERR_NULL;
+        return ECS_ERR_MEM;
     }
 
-    component_info_t *comp_info = &cs->components[comp_info_ind];
+    ecs_entity_t *entities = hierarchy->entities.data;
+    int *parent_indices = hierarchy->parent_indices.data;
+    int ret = 0;
+    sparse_map_clear(&hierarchy->positions);
+    sparse_map_clear(&hierarchy->parents);
+    for (int i = 0; i < hierarchy->entities.size; ++i)
+    {
+        ret |= sparse_map_insert(&hierarchy->positions, entities[i], i);
+        if (parent_indices[i] >= 0)
+        {
+            ret |= sparse_map_insert(&hierarchy->parents, entities[i], entities[parent_indices[i]]);
+        }
+    }
 
-    int comp_ind;
-    itoi_map_get(&comp_info->entity_to_index_map, entity, &comp_ind);
-    vector_get(&comp_info->array, comp_ind, dest);
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+// The hierarchy is copied whole on its first change after a fork
+static ecs_err_t save_fork_hierarchy(ecs_world_t *world)
+{
+    if (!world->forked || world->fork_hierarchy)
+    {
+        return ECS_OK;
+    }
+
+    hierarchy_t *hierarchy = &world->hierarchy;
+    hierarchy_t *fork_hierarchy = malloc(sizeof(hierarchy_t));
+    if (fork_hierarchy == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+    init_hierarchy(fork_hierarchy);
+    if (vector_resize(&fork_hierarchy->entities, hierarchy->entities.size) ||
+            vector_resize(&fork_hierarchy->sizes, hierarchy->sizes.size))
+    {
+        free_hierarchy(fork_hierarchy);
+        free(fork_hierarchy);
+        return ECS_ERR_MEM;
+    }
+    if (hierarchy->entities.size > 0)
+    {
+        memcpy(fork_hierarchy->entities.data, hierarchy->entities.data, hierarchy->entities.size * sizeof(ecs_entity_t));
+        memcpy(fork_hierarchy->sizes.data, hierarchy->sizes.data, hierarchy->sizes.size * sizeof(int));
+    }
+    world->fork_hierarchy = fork_hierarchy;
 
     return ECS_OK;
 }
 
-bool ecs_entity_has_component_by_name(ecs_entity_t entity, const char *name)
+static ecs_err_t add_hierarchy_root(hierarchy_t *hierarchy, ecs_entity_t entity)
 {
-    int entity_ind, comp_info_id;
-    if (!itoi_map_get(&cs->entity_to_index_map, entity, &entity_ind) || 
-            !stoi_map_get(&cs->component_name_to_index_map, name, &comp_info_id)) 
+    if (sparse_map_get(&hierarchy->positions, entity, NULL))
     {
-        return false;
+        return ECS_OK;
     }
 
-    entity_info_t *entity_info;
-    vector_get(&cs->entities, entity_ind, (void **)&entity_info);
+    int size = 1;
+    if (vector_push_back(&hierarchy->entities, &entity) || vector_push_back(&hierarchy->sizes, &size) ||
+            sparse_map_insert(&hierarchy->positions, entity, hierarchy->entities.size - 1))
+    {
+        return ECS_ERR_MEM;
+    }
+    hierarchy->stale = true;
 
-    return (entity_info->signature & (1 << comp_info_id)) != 0;
+    return ECS_OK;
 }
 
-ecs_err_t ecs_register_system(ecs_system_t system, ecs_signature_t signature, ecs_system_event_t event)
+static void adjust_ancestor_sizes(hierarchy_t *hierarchy, ecs_entity_t entity, int delta)
 {
-    if (uiptrtoi_map_get(&cs->system_to_index_map, (uintptr_t)system, NULL))
+    int parent, pos;
+    while (sparse_map_get(&hierarchy->parents, entity, &parent))
     {
-        return ECS_ERR_EXISTS;
+        sparse_map_get(&hierarchy->positions, parent, &pos);
+        ((int *)hierarchy->sizes.data)[pos] += delta;
+        entity = parent;
     }
+}
 
-    vector_push_back(&cs->systems, &(system_info_t){ .system=system, .event=event, .signature=signature });
-    uiptrtoi_map_insert(&cs->system_to_index_map, (uintptr_t)system, cs->systems.size - 1);
+static void reverse_nodes(hierarchy_t *hierarchy, int first, int last)
+{
+    ecs_entity_t *entities = hierarchy->entities.data;
+    int *sizes = hierarchy->sizes.data;
+    for (--last; first < last; ++first, --last)
+    {
+        ecs_entity_t entity = entities[first];
+        entities[first] = entities[last];
+        entities[last] = entity;
 
-    system_info_t *sys_info;
-    vector_get(&cs->systems, cs->systems.size - 1, (void **)&sys_info);
+        int size = sizes[first];
+        sizes[first] = sizes[last];
+        sizes[last] = size;
+    }
+}
 
-    vector_init(&sys_info->entities_v, sizeof(ecs_entity_t), 1);
-    set_init(&sys_info->entities_s);
+// Moves the `count` nodes at `first` to `dest`, an index of the order
+// without them, by rotating the range in between
+static void move_nodes(hierarchy_t *hierarchy, int first, int count, int dest)
+{
+    int lo = dest < first ? dest : first;
+    int hi = dest < first ? first + count : dest + count;
+    int mid = dest < first ? first : first + count;
+    if (lo == mid || mid == hi)
+    {
+        return;
+    }
 
+    reverse_nodes(hierarchy, lo, mid);
+    reverse_nodes(hierarchy, mid, hi);
+    reverse_nodes(hierarchy, lo, hi);
 
-    switch (event)
+    ecs_entity_t *entities = hierarchy->entities.data;
+    for (int i = lo; i < hi; ++i)
     {
-        case ECS_SYSTEM_ON_INIT:
-            vector_push_back(&cs->on_init_system_indices, &((int){ cs->systems.size - 1 }));
-            break;
-        case ECS_SYSTEM_ON_UPDATE:
-            vector_push_back(&cs->on_update_system_indices, &((int){ cs->systems.size - 1 }));
-            break;
-        case ECS_SYSTEM_ON_END:
-            vector_push_back(&cs->on_end_system_indices, &((int){ cs->systems.size - 1 }));
-            break;
-        default: break;
+        sparse_map_insert(&hierarchy->positions, entities[i], i);
     }
-
-    return ECS_OK;
+    hierarchy->stale = true;
 }
 
-ecs_err_t ecs_unregister_system(ecs_system_t system)
+ecs_err_t delete_subtree(ecs_world_t *world, int pos)
 {
-    int sys_info_id;
-    if (!uiptrtoi_map_get(&cs->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    if (save_fork_hierarchy(world) != ECS_OK)
     {
-        return ECS_ERR_NULL;
+        return ECS_ERR_MEM;
     }
 
-    system_info_t *sys_info;
-    vector_get(&cs->systems, sys_info_id, (void **)&sys_info);
+    // The descendants [pos + 1, pos + size) are deleted in one batch, then
+    // the subtree is cut out in one block
+    hierarchy_t *hierarchy = &world->hierarchy;
+    ecs_entity_t entity = ((ecs_entity_t *)hierarchy->entities.data)[pos];
+    int count = ((int *)hierarchy->sizes.data)[pos];
+    if (delete_entities(world, (ecs_entity_t *)hierarchy->entities.data + pos + 1, count - 1, true) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
 
-    free(sys_info->args);
-    vector_free(&sys_info->entities_v);
-    set_free(&sys_info->entities_s);
-    vector_remove(&cs->systems, sys_info_id);
+    int first = hierarchy->entities.size - count;
+    adjust_ancestor_sizes(hierarchy, entity, -count);
+    move_nodes(hierarchy, pos, count, first);
+    hierarchy->entities.size = first;
+    hierarchy->sizes.size = first;
+    hierarchy->stale = true;
 
-    // Edit mappings
-    // TODO
-    uiptrtoi_map_remove(&cs->system_to_index_map, (uintptr_t)system);
+    ecs_entity_t *entities = hierarchy->entities.data;
+    for (int i = first; i < first + count; ++i)
+    {
+        sparse_map_remove(&hierarchy->positions, entities[i]);
+        sparse_map_remove(&hierarchy->parents, entities[i]);
+    }
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_set_system_parameters(ecs_system_t system, int argc, void *argv[])
+ecs_err_t ecs_world_set_parent(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t parent)
 {
-    int sys_info_id;
-    if (!uiptrtoi_map_get(&cs->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    if (flush_reserved_entities(world) != ECS_OK || !sparse_map_get(&world->entity_to_index_map, entity, NULL) ||
+            (parent && !sparse_map_get(&world->entity_to_index_map, parent, NULL)) || entity == parent)
     {
         return ECS_ERR_NULL;
     }
 
-    system_info_t *sys_info;
-    vector_get(&cs->systems, sys_info_id, (void **)&sys_info);
-
-    sys_info->args = malloc(sizeof(void *) * argc);
-    if (sys_info->args == NULL)
+    hierarchy_t *hierarchy = &world->hierarchy;
+    int old_parent;
+    if ((sparse_map_get(&hierarchy->parents, entity, &old_parent) ? (ecs_entity_t)old_parent : 0) == parent)
+    {
+        return ECS_OK;
+    }
+    if (save_fork_hierarchy(world) != ECS_OK || add_hierarchy_root(hierarchy, entity) != ECS_OK ||
+            (parent && add_hierarchy_root(hierarchy, parent) != ECS_OK))
     {
         return ECS_ERR_MEM;
     }
-    memcpy(sys_info->args, argv, sizeof(void *) * argc);
+
+    int pos, parent_pos = -1;
+    sparse_map_get(&hierarchy->positions, entity, &pos);
+    int count = ((int *)hierarchy->sizes.data)[pos];
+
+    // A node cannot move under its own subtree
+    if (parent)
+    {
+        sparse_map_get(&hierarchy->positions, parent, &parent_pos);
+        if (parent_pos >= pos && parent_pos < pos + count)
+        {
+            return ECS_ERR;
+        }
+    }
+
+    adjust_ancestor_sizes(hierarchy, entity, -count);
+
+    // Placed after the last descendant of the new parent, or last as a root
+    int dest = hierarchy->entities.size - count;
+    if (parent)
+    {
+        dest = (parent_pos > pos ? parent_pos - count : parent_pos) + ((int *)hierarchy->sizes.data)[parent_pos];
+        sparse_map_insert(&hierarchy->parents, entity, parent);
+    }
+    else
+    {
+        sparse_map_remove(&hierarchy->parents, entity);
+    }
+    move_nodes(hierarchy, pos, count, dest);
+    adjust_ancestor_sizes(hierarchy, entity, count);
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_call_system(ecs_system_t system)
+ecs_err_t ecs_world_get_parent(ecs_world_t *world, ecs_entity_t entity, ecs_entity_t *parent)
 {
-    int sys_info_id;
-    if (!uiptrtoi_map_get(&cs->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    int parent_entity;
+    if (!sparse_map_get(&world->entity_to_index_map, entity, NULL))
     {
         return ECS_ERR_NULL;
     }
-
-    system_info_t *sys_info;
-    vector_get(&cs->systems, sys_info_id, (void **)&sys_info);
-
-    sys_info->system((ecs_entity_t *)sys_info->entities_v.data, sys_info->entities_v.size, sys_info->args);
+    *parent = sparse_map_get(&world->hierarchy.parents, entity, &parent_entity) ? (ecs_entity_t)parent_entity : 0;
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_listen_systems(ecs_system_event_t event)
+ecs_err_t ecs_world_get_descendants(ecs_world_t *world, ecs_entity_t entity, const ecs_entity_t **descendants, int *count)
 {
-    int sys_id;
-    system_info_t *sys_info;
-    vector_t *sys_indices;
-    switch (event) 
+    int pos;
+    if (!sparse_map_get(&world->entity_to_index_map, entity, NULL))
     {
-        case ECS_SYSTEM_ON_INIT:
-            sys_indices = &cs->on_init_system_indices;
-            break;
-        case ECS_SYSTEM_ON_UPDATE:
-            sys_indices = &cs->on_update_system_indices;
-            break;
-        case ECS_SYSTEM_ON_END:
-            sys_indices = &cs->on_end_system_indices;
-            break;
-        default:
-            return ECS_ERR_NULL;
+        return ECS_ERR_NULL;
     }
 
-    for (int i = 0; i < sys_indices->size; ++i)
+    *descendants = NULL;
+    *count = 0;
+    if (sparse_map_get(&world->hierarchy.positions, entity, &pos))
     {
-        vector_get_copy(sys_indices, i, &sys_id);
-        vector_get(&cs->systems, sys_id, (void **)&sys_info);
-        sys_info->status = sys_info->system((ecs_entity_t *)sys_info->entities_v.data, sys_info->entities_v.size, sys_info->args);
+        *descendants = (ecs_entity_t *)world->hierarchy.entities.data + pos + 1;
+        *count = ((int *)world->hierarchy.sizes.data)[pos] - 1;
     }
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_create_signature_by_names(ecs_signature_t *signature, const char *names)
+ecs_err_t ecs_world_get_hierarchy(ecs_world_t *world, const ecs_entity_t **entities, const int **parents, int *count)
 {
-    char *names_cpy = strdup(names);
-    if (names_cpy == NULL)
+    if (update_parent_indices(&world->hierarchy) != ECS_OK)
     {
-        return ECS_ERR_NULL;
+        return ECS_ERR_MEM;
     }
 
-    ecs_signature_t sign = 0;
-    char *name = strtok(names_cpy, ",");
-    while (name != NULL)
+    *entities = world->hierarchy.entities.data;
+    *parents = world->hierarchy.parent_indices.data;
+    *count = world->hierarchy.entities.size;
+
+    return ECS_OK;
+}
+
+ecs_err_t pool_reserve(component_info_t *comp_info, int capacity)
+{
+    vector_t *array = &comp_info->array;
+    if (capacity <= array->capacity)
     {
-        while (*name == ' ') name++;
-        int ind;
-        if (!stoi_map_get(&cs->component_name_to_index_map, name, &ind))
-        {
-            free(names_cpy);
-            return ECS_ERR_NULL;
-        }
+        return ECS_OK;
+    }
 
-        sign |= (1 << ind);
-        name = strtok(NULL, ",");
+    int new_capacity = array->capacity ? array->capacity : 1;
+    while (new_capacity < capacity)
+    {
+        new_capacity *= 2;
     }
 
-    *signature = sign;
+    // Sized ahead so slots can be marked stale from any thread
+    if (reserve_stale_chunks(comp_info, new_capacity) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
 
-    free(names_cpy);
+    // Trivially relocatable components are moved by realloc
+    if (comp_info->hooks.move == NULL)
+    {
+        return vector_reserve(array, new_capacity - array->capacity) ? ECS_ERR_MEM : ECS_OK;
+    }
+
+    void *ndata = malloc(new_capacity * array->element_size);
+    if (ndata == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+    if (array->size > 0)
+    {
+        comp_info->hooks.move(ndata, array->data, array->size);
+    }
+    free(array->data);
+    array->data = ndata;
+    array->capacity = new_capacity;
 
     return ECS_OK;
 }
 
-ecs_err_t ecs_get_system_status(ecs_system_t system, ecs_err_t *ret)
+ecs_err_t add_component_slot(ecs_world_t *world, ecs_entity_t entity, const char *name, void **slot)
 {
-    int sys_info_id;
-    if (!uiptrtoi_map_get(&cs->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    int entity_ind, comp_info_ind;
+    if (flush_reserved_entities(world) != ECS_OK || !sparse_map_get(&world->entity_to_index_map, entity, &entity_ind) || 
+            !stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind)) 
     {
         return ECS_ERR_NULL;
     }
 
-    system_info_t *sys_info;
-    vector_get(&cs->systems, sys_info_id, (void **)&sys_info);
+    // Check if entity already has the component
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (sparse_map_get(&comp_info->entity_to_index_map, entity, NULL))
+    {
+        return ECS_ERR_EXISTS;
+    }
 
-    *ret = sys_info->status;
+    entity_info_t *entity_info;
+    vector_get(&world->entities, entity_ind, (void **)&entity_info);
 
-    return ECS_OK;
+    journal_write(&comp_info->array_journal, &comp_info->array, comp_info->array.size, 1);
+    journal_write(&comp_info->entities_journal, &comp_info->entities, comp_info->entities.size, 1);
+    if (pool_reserve(comp_info, comp_info->array.size + 1) != ECS_OK ||
+            sparse_map_reserve(&comp_info->entity_to_index_map, entity) ||
+            reserve_query_membership(world, entity, entity_info->signature | (1 << comp_info_ind)) != ECS_OK ||
+            vector_push_back(&comp_info->entities, &entity))
+    {
+        return ECS_ERR_MEM;
+    }
+    mark_chunks_stale(comp_info, comp_info->array.size, 1);
+    vector_get(&comp_info->array, comp_info->array.size++, slot);
+    // Appended out of key order, compaction orders the pool again
+    comp_info->key_sorted = false;
+
+    // Append to the mapping
+    sparse_map_insert(&comp_info->entity_to_index_map, entity, comp_info->array.size - 1);
+
+    journal_write(&world->entities_journal, &world->entities, entity_ind, 1);
+    entity_info->signature |= (1 << comp_info_ind);
+
+    update_query_membership(world, entity, entity_info->signature, true);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_add_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, void *default_value)
+{
+    void *comp;
+    ecs_err_t ret = add_component_slot(world, entity, name, &comp);
+    if (ret != ECS_OK)
+    {
+        return ret;
+    }
+
+    int comp_info_ind;
+    stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind);
+    component_info_t *comp_info = &world->components[comp_info_ind];
+
+    // Set default value or empty value, buffers always start empty
+    if (default_value && comp_info->buffer == NULL)
+    {
+        if (comp_info->hooks.copy)
+        {
+            comp_info->hooks.copy(comp, default_value, 1);
+        }
+        else
+        {
+            memcpy(comp, default_value, comp_info->array.element_size);
+        }
+    }
+    else if (comp_info->hooks.ctor)
+    {
+        comp_info->hooks.ctor(comp, 1);
+    }
+    else
+    {
+        memset(comp, 0, comp_info->array.element_size);
+    }
+    sync_previous_slots(comp_info, comp_info->array.size - 1);
+
+    return index_components(world, comp_info_ind, comp_info->array.size - 1, 1);
+}
+
+ecs_err_t ecs_world_emplace_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, void **dest)
+{
+    // The slot is left uninitialised for the caller to construct in place,
+    // it is indexed by ecs_set_component or ecs_reindex_component
+    ecs_err_t ret = add_component_slot(world, entity, name, dest);
+    if (ret != ECS_OK)
+    {
+        return ret;
+    }
+
+    // Double buffered pools read the new slot as zeroes until the next flip
+    // carries the constructed value over
+    int comp_info_ind;
+    stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind);
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (comp_info->double_buffered)
+    {
+        memset(*dest, 0, comp_info->array.element_size);
+        sync_previous_slots(comp_info, comp_info->array.size - 1);
+        mark_chunk_dirty(comp_info, comp_info->array.size - 1);
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_set_component_hooks_by_name(ecs_world_t *world, const char *name, const ecs_component_hooks_t *hooks)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    // Hooks cannot change under live or shallow copied components
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (comp_info->array.size > 0 || comp_info->resource || comp_info->double_buffered)
+    {
+        return ECS_ERR_EXISTS;
+    }
+    if (comp_info->buffer)
+    {
+        return ECS_ERR;
+    }
+    if (world->forked)
+    {
+        return ECS_ERR;
+    }
+
+    comp_info->hooks = hooks ? *hooks : (ecs_component_hooks_t){ 0 };
+
+    return ECS_OK;
+}
+
+void destroy_components(component_info_t *comp_info)
+{
+    // Batched per column
+    if (comp_info->hooks.dtor && comp_info->array.size > 0)
+    {
+        comp_info->hooks.dtor(comp_info->array.data, comp_info->array.size);
+    }
+    if (comp_info->hooks.dtor && comp_info->resource)
+    {
+        comp_info->hooks.dtor(comp_info->resource, 1);
+    }
+}
+
+static inline bool query_matches(query_info_t *query_info, ecs_signature_t signature)
+{
+    return (signature & query_info->with) == query_info->with && !(signature & query_info->without);
+}
+
+// Room in the queries an entity joins with that signature
+ecs_err_t reserve_query_membership(ecs_world_t *world, ecs_entity_t entity, ecs_signature_t signature)
+{
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info = (query_info_t *)world->queries.data + i;
+        if (query_info->used && query_matches(query_info, signature) &&
+                !sparse_map_get(&query_info->entity_to_index_map, entity, NULL) &&
+                (vector_reserve_size(&query_info->entities, query_info->entities.size + 1) ||
+                 sparse_map_reserve(&query_info->entity_to_index_map, entity)))
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    return ECS_OK;
+}
+
+// Queries hold exactly the live entities matching them. Membership is
+// looked up rather than derived from the previous signature, so queries
+// requiring no component get new entities and lose deleted ones too.
+void update_query_membership(ecs_world_t *world, ecs_entity_t entity, ecs_signature_t signature, bool alive)
+{
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        if (!query_info->used)
+        {
+            continue;
+        }
+
+        bool was_member = sparse_map_get(&query_info->entity_to_index_map, entity, NULL);
+        bool is_member = alive && query_matches(query_info, signature);
+        if (was_member == is_member)
+        {
+            continue;
+        }
+
+        if (is_member)
+        {
+            // Reserved beforehand, but for unregistered components
+            if (sparse_map_reserve(&query_info->entity_to_index_map, entity) ||
+                    vector_reserve_size(&query_info->entities, query_info->entities.size + 1))
+            {
+                continue;
+            }
+            journal_write(&query_info->entities_journal, &query_info->entities, query_info->entities.size, 1);
+            vector_push_back(&query_info->entities, &entity);
+            sparse_map_insert(&query_info->entity_to_index_map, entity, query_info->entities.size - 1);
+            set_enabled_bit(query_info, query_info->entities.size - 1, !is_inactive_member(world, query_info, entity));
+        }
+        else
+        {
+            remove_query_entity(query_info, entity);
+        }
+    }
+}
+
+void remove_query_entity(query_info_t *query_info, ecs_entity_t entity)
+{
+    // Swap the last entity into the hole
+    int del_ind, last_ind = query_info->entities.size - 1;
+    sparse_map_get(&query_info->entity_to_index_map, entity, &del_ind);
+    journal_write(&query_info->entities_journal, &query_info->entities, del_ind, 1);
+    journal_write(&query_info->entities_journal, &query_info->entities, last_ind, 1);
+
+    ecs_entity_t *entities = query_info->entities.data;
+    entities[del_ind] = entities[last_ind];
+    sparse_map_insert(&query_info->entity_to_index_map, entities[del_ind], del_ind);
+    if (!query_info->enabled_stale)
+    {
+        uint64_t *words = query_info->enabled.data;
+        set_enabled_bit(query_info, del_ind, (words[last_ind / 64] >> (last_ind % 64)) & 1);
+        set_enabled_bit(query_info, last_ind, false);
+    }
+
+    --query_info->entities.size;
+    sparse_map_remove(&query_info->entity_to_index_map, entity);
+}
+
+// Slots relocated elsewhere are dropped without being destroyed
+ecs_err_t remove_component_by_index(ecs_world_t *world, ecs_entity_t entity, uint8_t index, bool destroy)
+{
+    int entity_ind;
+    if (!sparse_map_get(&world->entity_to_index_map, entity, &entity_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    entity_info_t *entity_info;
+    vector_get(&world->entities, entity_ind, (void **)&entity_info);
+
+    // Check if entity has the component
+    if (!(entity_info->signature & (1 << index)))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    // Queries excluding the component may take the entity
+    ecs_signature_t signature = entity_info->signature & ~(1 << index);
+    if (reserve_query_membership(world, entity, signature) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    drop_component_slot(world, entity, index, destroy);
+
+    journal_write(&world->entities_journal, &world->entities, entity_ind, 1);
+    entity_info->signature = signature;
+    entity_info->disabled_components &= ~(1 << index);
+    update_inactive_bit(world, entity_info);
+
+    update_query_membership(world, entity, signature, true);
+
+    return ECS_OK;
+}
+
+// Removes the slot of an entity from a pool, leaving the entity as is
+void drop_component_slot(ecs_world_t *world, ecs_entity_t entity, uint8_t index, bool destroy)
+{
+    // Remove component from component array
+    // Step 1 - get del comp ind and last comp ind
+    component_info_t *comp_info = &world->components[index];
+    int del_comp_ind, last_comp_ind;
+    sparse_map_get(&comp_info->entity_to_index_map, entity, &del_comp_ind);
+    last_comp_ind = comp_info->array.size - 1;
+    journal_write(&comp_info->array_journal, &comp_info->array, del_comp_ind, 1);
+    journal_write(&comp_info->array_journal, &comp_info->array, last_comp_ind, 1);
+    journal_write(&comp_info->entities_journal, &comp_info->entities, del_comp_ind, 1);
+    journal_write(&comp_info->entities_journal, &comp_info->entities, last_comp_ind, 1);
+    mark_chunks_stale(comp_info, del_comp_ind, 1);
+    mark_chunks_stale(comp_info, last_comp_ind, 1);
+
+    void *del_comp, *last_comp;
+    vector_get(&comp_info->array, del_comp_ind, &del_comp);
+    if (comp_info->index_count > 0)
+    {
+        unindex_component(world, index, entity);
+    }
+    if (comp_info->spatial_count > 0)
+    {
+        unindex_spatial(world, index, entity);
+    }
+    if (destroy && comp_info->hooks.dtor)
+    {
+        comp_info->hooks.dtor(del_comp, 1);
+    }
+    if (destroy && comp_info->buffer)
+    {
+        release_buffer(comp_info, del_comp);
+    }
+
+    // Only perform shift if necessary
+    if (del_comp_ind != last_comp_ind)
+    {
+        vector_get(&comp_info->array, last_comp_ind, &last_comp);
+        if (comp_info->hooks.move)
+        {
+            comp_info->hooks.move(del_comp, last_comp, 1);
+        }
+        else
+        {
+            memcpy(del_comp, last_comp, comp_info->array.element_size);
+        }
+        if (comp_info->double_buffered)
+        {
+            vector_get(&comp_info->previous, del_comp_ind, &del_comp);
+            vector_get(&comp_info->previous, last_comp_ind, &last_comp);
+            memcpy(del_comp, last_comp, comp_info->array.element_size);
+        }
+
+        // Update mappings
+        ecs_entity_t last_entity;
+        vector_get_copy(&comp_info->entities, last_comp_ind, &last_entity);
+        ((ecs_entity_t *)comp_info->entities.data)[del_comp_ind] = last_entity;
+        sparse_map_insert(&comp_info->entity_to_index_map, last_entity, del_comp_ind);
+    }
+
+    // Remove last component and entity mapping
+    --comp_info->array.size;
+    --comp_info->entities.size;
+    comp_info->previous.size = comp_info->double_buffered ? comp_info->array.size : 0;
+    sparse_map_remove(&comp_info->entity_to_index_map, entity);
+}
+
+ecs_err_t ecs_world_remove_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name)
+{
+    int comp_info_ind;
+    if (flush_reserved_entities(world) != ECS_OK || !stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind)) 
+    {
+        return ECS_ERR_NULL;
+    }
+
+    return remove_component_by_index(world, entity, comp_info_ind, true);
+}
+
+ecs_err_t ecs_world_get_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, void **dest)
+{
+    int entity_ind, comp_info_ind;
+    if (!sparse_map_get(&world->entity_to_index_map, entity, &entity_ind) || 
+            !stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind)) 
+    {
+        return ECS_ERR_NULL;
+    }
+
+    return ecs_world_get_component_by_id(world, entity, comp_info_ind, dest);
+}
+
+ecs_err_t ecs_world_get_component_id(ecs_world_t *world, const char *name, int *id)
+{
+    return stoi_map_get(&world->component_name_to_index_map, name, id) ? ECS_OK : ECS_ERR_NULL;
+}
+
+ecs_err_t ecs_world_get_component_by_id(ecs_world_t *world, ecs_entity_t entity, int id, void **dest)
+{
+    if (id < 0 || id >= ECS_MAX_COMPONENTS)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[id];
+
+    int comp_ind;
+    if (!sparse_map_get(&comp_info->entity_to_index_map, entity, &comp_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+    vector_get(&comp_info->array, comp_ind, dest);
+
+    // The slot may be written through the returned pointer
+    journal_write(&comp_info->array_journal, &comp_info->array, comp_ind, 1);
+    mark_chunks_stale(comp_info, comp_ind, 1);
+    if (comp_info->double_buffered)
+    {
+        mark_chunk_dirty(comp_info, comp_ind);
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_set_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, const void *value)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+
+    int comp_ind;
+    if (!sparse_map_get(&comp_info->entity_to_index_map, entity, &comp_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    // Buffers are written through the buffer API only, components owning
+    // resources through their copy hook
+    if (comp_info->buffer || (comp_info->hooks.dtor && !comp_info->hooks.copy))
+    {
+        return ECS_ERR;
+    }
+
+    void *comp;
+    vector_get(&comp_info->array, comp_ind, &comp);
+    journal_write(&comp_info->array_journal, &comp_info->array, comp_ind, 1);
+    mark_chunks_stale(comp_info, comp_ind, 1);
+    if (comp_info->index_count > 0)
+    {
+        unindex_component(world, comp_info_ind, entity);
+    }
+
+    if (comp_info->hooks.copy)
+    {
+        if (comp_info->hooks.dtor)
+        {
+            comp_info->hooks.dtor(comp, 1);
+        }
+        comp_info->hooks.copy(comp, value, 1);
+    }
+    else
+    {
+        memcpy(comp, value, comp_info->array.element_size);
+    }
+    if (comp_info->double_buffered)
+    {
+        mark_chunk_dirty(comp_info, comp_ind);
+    }
+
+    return index_components(world, comp_info_ind, comp_ind, 1);
+}
+
+ecs_err_t ecs_world_get_previous_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, const void **dest)
+{
+    int comp_info_ind, comp_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (!comp_info->double_buffered || !sparse_map_get(&comp_info->entity_to_index_map, entity, &comp_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+    vector_get(&comp_info->previous, comp_ind, (void **)dest);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_get_components_by_name(ecs_world_t *world, const char *name, void **data, ecs_entity_t **entities, int *count)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    ecs_column_t column;
+    ecs_world_get_column(world, comp_info_ind, &column);
+    *data = column.data;
+    *entities = (ecs_entity_t *)column.entities;
+    *count = column.count;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_get_column(ecs_world_t *world, int id, ecs_column_t *column)
+{
+    if (id < 0 || id >= ECS_MAX_COMPONENTS || world->components[id].array.element_size == 0)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[id];
+    column->data = comp_info->array.data;
+    column->entities = comp_info->entities.data;
+    column->count = comp_info->array.size;
+    column->slots = comp_info->entity_to_index_map.values.data;
+    column->slot_count = comp_info->entity_to_index_map.values.size;
+
+    // Every slot may be written through the returned column
+    journal_write(&comp_info->array_journal, &comp_info->array, 0, comp_info->array.size);
+    mark_chunks_stale(comp_info, 0, comp_info->array.size);
+    for (int i = 0; comp_info->double_buffered && i < comp_info->array.size; i += CHUNK_SIZE)
+    {
+        mark_chunk_dirty(comp_info, i);
+    }
+
+    return ECS_OK;
+}
+
+// Slots of a batch in the order to copy them, along with their position in
+// the batch. Freed by the caller.
+static ecs_err_t resolve_batch(component_info_t *comp_info, const ecs_entity_t *entities, int count, uint64_t **slots, uint32_t **positions)
+{
+    bool sorted = count >= BATCH_SORT_MIN && comp_info->array.size * comp_info->array.element_size >= BATCH_SORT_BYTES;
+    *slots = malloc((sorted ? 2 : 1) * count * sizeof(uint64_t) + 1);
+    *positions = malloc((sorted ? 2 : 1) * count * sizeof(uint32_t) + 1);
+    if (*slots == NULL || *positions == NULL)
+    {
+        free(*slots);
+        free(*positions);
+        return ECS_ERR_MEM;
+    }
+
+    const int *entity_slots = comp_info->entity_to_index_map.values.data;
+    int entity_count = comp_info->entity_to_index_map.values.size;
+    for (int i = 0; i < count; ++i)
+    {
+        if (i + BATCH_PREFETCH < count && entities[i + BATCH_PREFETCH] < (ecs_entity_t)entity_count)
+        {
+            __builtin_prefetch(&entity_slots[entities[i + BATCH_PREFETCH]]);
+        }
+
+        int slot = entities[i] < (ecs_entity_t)entity_count ? entity_slots[entities[i]] : -1;
+        if (slot < 0)
+        {
+            free(*slots);
+            free(*positions);
+            return ECS_ERR_NULL;
+        }
+        (*slots)[i] = slot;
+        (*positions)[i] = i;
+    }
+
+    // Stable, repeated entities keep their batch order
+    if (sorted)
+    {
+        radix_sort_u64(*slots, *positions, count, *slots + count, *positions + count);
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_gather_components(ecs_world_t *world, int id, const ecs_entity_t *entities, int count, void *dst, size_t stride)
+{
+    if (id < 0 || id >= ECS_MAX_COMPONENTS || world->components[id].array.element_size == 0 || count < 0)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[id];
+    if (comp_info->buffer)
+    {
+        return ECS_ERR;
+    }
+
+    uint64_t *slots;
+    uint32_t *positions;
+    ecs_err_t ret = resolve_batch(comp_info, entities, count, &slots, &positions);
+    if (ret != ECS_OK)
+    {
+        return ret;
+    }
+
+    size_t element_size = comp_info->array.element_size;
+    stride = stride ? stride : element_size;
+    const char *data = comp_info->array.data;
+    for (int i = 0; i < count; ++i)
+    {
+        if (i + BATCH_PREFETCH < count)
+        {
+            __builtin_prefetch(data + slots[i + BATCH_PREFETCH] * element_size);
+        }
+
+        char *to = (char *)dst + positions[i] * stride;
+        if (comp_info->hooks.copy)
+        {
+            comp_info->hooks.copy(to, data + slots[i] * element_size, 1);
+        }
+        else
+        {
+            memcpy(to, data + slots[i] * element_size, element_size);
+        }
+    }
+
+    free(slots);
+    free(positions);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_scatter_components(ecs_world_t *world, int id, const ecs_entity_t *entities, int count, const void *src, size_t stride)
+{
+    if (id < 0 || id >= ECS_MAX_COMPONENTS || world->components[id].array.element_size == 0 || count < 0)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[id];
+    if (comp_info->buffer || (comp_info->hooks.dtor && !comp_info->hooks.copy))
+    {
+        return ECS_ERR;
+    }
+
+    uint64_t *slots;
+    uint32_t *positions;
+    ecs_err_t ret = resolve_batch(comp_info, entities, count, &slots, &positions);
+    if (ret != ECS_OK)
+    {
+        return ret;
+    }
+
+    size_t element_size = comp_info->array.element_size;
+    stride = stride ? stride : element_size;
+    char *data = comp_info->array.data;
+    for (int i = 0; i < count; ++i)
+    {
+        if (i + BATCH_PREFETCH < count)
+        {
+            __builtin_prefetch(data + slots[i + BATCH_PREFETCH] * element_size, 1);
+        }
+
+        int slot = slots[i];
+        char *comp = data + slot * element_size;
+        const char *from = (const char *)src + positions[i] * stride;
+        journal_write(&comp_info->array_journal, &comp_info->array, slot, 1);
+        mark_chunks_stale(comp_info, slot, 1);
+        if (comp_info->index_count > 0)
+        {
+            unindex_component(world, id, entities[positions[i]]);
+        }
+
+        if (comp_info->hooks.copy)
+        {
+            if (comp_info->hooks.dtor)
+            {
+                comp_info->hooks.dtor(comp, 1);
+            }
+            comp_info->hooks.copy(comp, from, 1);
+        }
+        else
+        {
+            memcpy(comp, from, element_size);
+        }
+        if (comp_info->double_buffered)
+        {
+            mark_chunk_dirty(comp_info, slot);
+        }
+        if (comp_info->index_count > 0)
+        {
+            ret |= index_components(world, id, slot, 1);
+        }
+    }
+
+    free(slots);
+    free(positions);
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+ecs_err_t ecs_world_get_previous_components_by_name(ecs_world_t *world, const char *name, const void **data, const ecs_entity_t **entities, int *count, uint32_t *generation)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (!comp_info->double_buffered)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    *generation = __atomic_load_n(&comp_info->generation, __ATOMIC_ACQUIRE);
+    *data = comp_info->previous.data;
+    *entities = comp_info->entities.data;
+    *count = comp_info->previous.size;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_get_component_generation_by_name(ecs_world_t *world, const char *name, uint32_t *generation)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    // Orders the reads of the previous buffer before the generation check
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    *generation = __atomic_load_n(&world->components[comp_info_ind].generation, __ATOMIC_ACQUIRE);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_set_component_double_buffered_by_name(ecs_world_t *world, const char *name, bool enabled)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (world->forked)
+    {
+        return ECS_ERR;
+    }
+    if (comp_info->double_buffered == enabled)
+    {
+        return ECS_OK;
+    }
+
+    // The previous buffer holds shallow copies
+    if (enabled && (comp_info->hooks.ctor || comp_info->hooks.dtor || comp_info->hooks.move || comp_info->hooks.copy || comp_info->buffer))
+    {
+        return ECS_ERR;
+    }
+
+    if (!enabled)
+    {
+        vector_free(&comp_info->previous);
+        vector_free(&comp_info->dirty_chunks);
+        comp_info->double_buffered = false;
+        return ECS_OK;
+    }
+
+    // Both buffers start identical
+    if (vector_init(&comp_info->previous, comp_info->array.element_size, comp_info->array.capacity) ||
+            vector_init(&comp_info->dirty_chunks, sizeof(uint64_t), 0))
+    {
+        vector_free(&comp_info->previous);
+        return ECS_ERR_MEM;
+    }
+    comp_info->previous.size = comp_info->array.size;
+    memcpy(comp_info->previous.data, comp_info->array.data, comp_info->array.size * comp_info->array.element_size);
+    comp_info->double_buffered = true;
+
+    return ECS_OK;
+}
+
+void mark_chunk_dirty(component_info_t *comp_info, int index)
+{
+    int chunk = index / CHUNK_SIZE;
+    int word = chunk / 64;
+    if (word >= comp_info->dirty_chunks.size)
+    {
+        int old_size = comp_info->dirty_chunks.size;
+        if (vector_resize(&comp_info->dirty_chunks, word + 1))
+        {
+            return;
+        }
+        memset((uint64_t *)comp_info->dirty_chunks.data + old_size, 0, (word + 1 - old_size) * sizeof(uint64_t));
+    }
+    ((uint64_t *)comp_info->dirty_chunks.data)[word] |= 1ull << (chunk % 64);
+}
+
+static ecs_err_t reserve_chunk_bits(vector_t *bits, int slots)
+{
+    int words = (slots + CHUNK_SIZE * 64 - 1) / (CHUNK_SIZE * 64);
+    int old_size = bits->size;
+    if (words <= old_size)
+    {
+        return ECS_OK;
+    }
+    if (vector_resize(bits, words))
+    {
+        return ECS_ERR_MEM;
+    }
+    memset((uint64_t *)bits->data + old_size, 0, (words - old_size) * sizeof(uint64_t));
+
+    return ECS_OK;
+}
+
+static void set_chunk_bits(vector_t *bits, int first, int count)
+{
+    if (reserve_chunk_bits(bits, first + count) != ECS_OK)
+    {
+        return;
+    }
+
+    uint64_t *words = bits->data;
+    for (int chunk = first / CHUNK_SIZE; chunk <= (first + count - 1) / CHUNK_SIZE; ++chunk)
+    {
+        __atomic_fetch_or(&words[chunk / 64], 1ull << (chunk % 64), __ATOMIC_RELAXED);
+    }
+}
+
+ecs_err_t reserve_stale_chunks(component_info_t *comp_info, int slots)
+{
+    if (reserve_chunk_bits(&comp_info->stale_chunks, slots) != ECS_OK ||
+            reserve_chunk_bits(&comp_info->moved_chunks, slots) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    return ECS_OK;
+}
+
+void mark_chunks_stale(component_info_t *comp_info, int first, int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    set_chunk_bits(&comp_info->stale_chunks, first, count);
+    if (comp_info->spatial_count > 0)
+    {
+        set_chunk_bits(&comp_info->moved_chunks, first, count);
+    }
+}
+
+// The generation is a sequence lock over the previous buffer, odd while it
+// is written and even once it is stable again
+void begin_previous_write(component_info_t *comp_info)
+{
+    __atomic_add_fetch(&comp_info->generation, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void end_previous_write(component_info_t *comp_info)
+{
+    __atomic_add_fetch(&comp_info->generation, 1, __ATOMIC_RELEASE);
+}
+
+void sync_previous_slots(component_info_t *comp_info, int first)
+{
+    if (!comp_info->double_buffered)
+    {
+        return;
+    }
+
+    size_t element_size = comp_info->array.element_size;
+    int count = comp_info->array.size - first;
+    begin_previous_write(comp_info);
+    if (vector_resize(&comp_info->previous, comp_info->array.size) == 0)
+    {
+        memcpy((char *)comp_info->previous.data + first * element_size, (char *)comp_info->array.data + first * element_size, count * element_size);
+    }
+    end_previous_write(comp_info);
+}
+
+void flip_component_buffers(component_info_t *comp_info)
+{
+    // Swap in O(1), the written slots of the new previous buffer are then
+    // carried over so both buffers hold the same state again
+    begin_previous_write(comp_info);
+    vector_t array = comp_info->array;
+    comp_info->array = comp_info->previous;
+    comp_info->previous = array;
+
+    size_t element_size = comp_info->array.element_size;
+    uint64_t *dirty_chunks = comp_info->dirty_chunks.data;
+    for (int word = 0; word < comp_info->dirty_chunks.size; ++word)
+    {
+        while (dirty_chunks[word])
+        {
+            int chunk = word * 64 + __builtin_ctzll(dirty_chunks[word]);
+            dirty_chunks[word] &= dirty_chunks[word] - 1;
+
+            int first = chunk * CHUNK_SIZE;
+            int count = comp_info->array.size - first < CHUNK_SIZE ? comp_info->array.size - first : CHUNK_SIZE;
+            if (count > 0)
+            {
+                memcpy((char *)comp_info->array.data + first * element_size, (char *)comp_info->previous.data + first * element_size, count * element_size);
+            }
+        }
+    }
+
+    end_previous_write(comp_info);
+}
+
+bool ecs_world_entity_has_component_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name)
+{
+    int entity_ind, comp_info_id;
+    if (!sparse_map_get(&world->entity_to_index_map, entity, &entity_ind) || 
+            !stoi_map_get(&world->component_name_to_index_map, name, &comp_info_id)) 
+    {
+        return false;
+    }
+
+    entity_info_t *entity_info;
+    vector_get(&world->entities, entity_ind, (void **)&entity_info);
+
+    return (entity_info->signature & (1 << comp_info_id)) != 0;
+}
+
+ecs_err_t update_inactive_bit(ecs_world_t *world, const entity_info_t *entity_info)
+{
+    bool inactive = entity_info->disabled || entity_info->disabled_components != 0;
+    int word = entity_info->entity / 64;
+    uint64_t bit = 1ull << (entity_info->entity % 64);
+    vector_t *bits = &world->inactive_entities;
+    bool was_inactive = word < bits->size && (((uint64_t *)bits->data)[word] & bit);
+    if (inactive == was_inactive)
+    {
+        return ECS_OK;
+    }
+
+    if (inactive)
+    {
+        int old_size = bits->size;
+        if (word >= old_size)
+        {
+            if (vector_resize(bits, word + 1))
+            {
+                return ECS_ERR_MEM;
+            }
+            memset((uint64_t *)bits->data + old_size, 0, (bits->size - old_size) * sizeof(uint64_t));
+        }
+        ((uint64_t *)bits->data)[word] |= bit;
+        ++world->inactive_count;
+    }
+    else
+    {
+        ((uint64_t *)bits->data)[word] &= ~bit;
+        --world->inactive_count;
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t rebuild_inactive_entities(ecs_world_t *world)
+{
+    if (world->inactive_entities.size > 0)
+    {
+        memset(world->inactive_entities.data, 0, world->inactive_entities.size * sizeof(uint64_t));
+    }
+    world->inactive_count = 0;
+
+    int ret = 0;
+    for (int i = 0; i < world->entities.size; ++i)
+    {
+        ret |= update_inactive_bit(world, (entity_info_t *)world->entities.data + i);
+    }
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        ((query_info_t *)world->queries.data + i)->enabled_stale = true;
+    }
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+bool is_inactive_member(ecs_world_t *world, query_info_t *query_info, ecs_entity_t entity)
+{
+    int word = entity / 64;
+    if (word >= world->inactive_entities.size || !(((uint64_t *)world->inactive_entities.data)[word] & (1ull << (entity % 64))))
+    {
+        return false;
+    }
+
+    int entity_ind;
+    sparse_map_get(&world->entity_to_index_map, entity, &entity_ind);
+    entity_info_t *entity_info = (entity_info_t *)world->entities.data + entity_ind;
+
+    return entity_info->disabled || (entity_info->disabled_components & query_info->with);
+}
+
+// Called whenever an entity or one of its components is toggled, only the
+// bit of the entity in each query changes
+void update_enabled_bits(ecs_world_t *world, const entity_info_t *entity_info)
+{
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info = (query_info_t *)world->queries.data + i;
+        int ind;
+        if (query_info->used && sparse_map_get(&query_info->entity_to_index_map, entity_info->entity, &ind))
+        {
+            set_enabled_bit(query_info, ind, !entity_info->disabled && !(entity_info->disabled_components & query_info->with));
+        }
+    }
+}
+
+void set_enabled_bit(query_info_t *query_info, int ind, bool enabled)
+{
+    if (query_info->enabled_stale)
+    {
+        return;
+    }
+
+    vector_t *words = &query_info->enabled;
+    int word = ind / 64;
+    if (word >= words->size)
+    {
+        int old_size = words->size;
+        if (vector_resize(words, word + 1))
+        {
+            query_info->enabled_stale = true;
+            return;
+        }
+        memset((uint64_t *)words->data + old_size, 0, (words->size - old_size) * sizeof(uint64_t));
+    }
+
+    if (enabled)
+    {
+        ((uint64_t *)words->data)[word] |= 1ull << (ind % 64);
+    }
+    else
+    {
+        ((uint64_t *)words->data)[word] &= ~(1ull << (ind % 64));
+    }
+}
+
+// Sets the bits again from the entities when stale. Only the entities
+// flagged in the inactive bitset are looked up.
+ecs_err_t rebuild_enabled_bits(ecs_world_t *world, query_info_t *query_info)
+{
+    if (!query_info->enabled_stale)
+    {
+        return ECS_OK;
+    }
+
+    int size = query_info->entities.size;
+    vector_t *words = &query_info->enabled;
+    if (vector_resize(words, (size + 63) / 64))
+    {
+        return ECS_ERR_MEM;
+    }
+    if (words->size > 0)
+    {
+        memset(words->data, 0, words->size * sizeof(uint64_t));
+    }
+
+    ecs_entity_t *entities = query_info->entities.data;
+    for (int i = 0; i < size; ++i)
+    {
+        if (!is_inactive_member(world, query_info, entities[i]))
+        {
+            ((uint64_t *)words->data)[i / 64] |= 1ull << (i % 64);
+        }
+    }
+    query_info->enabled_stale = false;
+
+    return ECS_OK;
+}
+
+// First run of enabled entities in [from, end), returned with `count` set
+// to its length, or `end` when there is none. Words without a set bit are
+// passed whole, as are full words within a run.
+int next_enabled_run(query_info_t *query_info, int from, int end, int *count)
+{
+    const uint64_t *words = query_info->enabled.data;
+    int word = from / 64;
+    uint64_t bits = from < end ? words[word] & (~0ull << (from % 64)) : 0;
+    while (bits == 0 && ++word * 64 < end)
+    {
+        bits = words[word];
+    }
+    int first = word * 64 + (bits ? __builtin_ctzll(bits) : 0);
+    if (bits == 0 || first >= end)
+    {
+        *count = 0;
+        return end;
+    }
+
+    bits = ~words[word] & (~0ull << (first % 64));
+    while (bits == 0 && ++word * 64 < end)
+    {
+        bits = ~words[word];
+    }
+    int last = bits ? word * 64 + __builtin_ctzll(bits) : end;
+    *count = (last < end ? last : end) - first;
+
+    return first;
+}
+
+ecs_err_t ecs_world_set_entity_enabled(ecs_world_t *world, ecs_entity_t entity, bool enabled)
+{
+    int entity_ind;
+    if (flush_reserved_entities(world) != ECS_OK || !sparse_map_get(&world->entity_to_index_map, entity, &entity_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    entity_info_t *entity_info;
+    vector_get(&world->entities, entity_ind, (void **)&entity_info);
+    if (entity_info->disabled == !enabled)
+    {
+        return ECS_OK;
+    }
+
+    journal_write(&world->entities_journal, &world->entities, entity_ind, 1);
+    entity_info->disabled = !enabled;
+    if (update_inactive_bit(world, entity_info) != ECS_OK)
+    {
+        entity_info->disabled = false;
+        return ECS_ERR_MEM;
+    }
+    update_enabled_bits(world, entity_info);
+
+    return ECS_OK;
+}
+
+bool ecs_world_is_entity_enabled(ecs_world_t *world, ecs_entity_t entity)
+{
+    int entity_ind;
+    if (!sparse_map_get(&world->entity_to_index_map, entity, &entity_ind))
+    {
+        return false;
+    }
+
+    entity_info_t *entity_info;
+    vector_get(&world->entities, entity_ind, (void **)&entity_info);
+
+    return !entity_info->disabled;
+}
+
+ecs_err_t ecs_world_set_component_enabled_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, bool enabled)
+{
+    int entity_ind, comp_info_id;
+    if (flush_reserved_entities(world) != ECS_OK || !sparse_map_get(&world->entity_to_index_map, entity, &entity_ind) ||
+            !stoi_map_get(&world->component_name_to_index_map, name, &comp_info_id))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    entity_info_t *entity_info;
+    vector_get(&world->entities, entity_ind, (void **)&entity_info);
+    if (!(entity_info->signature & (1 << comp_info_id)))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    ecs_signature_t disabled_components = enabled ? entity_info->disabled_components & ~(1 << comp_info_id) : entity_info->disabled_components | (1 << comp_info_id);
+    if (disabled_components == entity_info->disabled_components)
+    {
+        return ECS_OK;
+    }
+
+    journal_write(&world->entities_journal, &world->entities, entity_ind, 1);
+    ecs_signature_t old_disabled_components = entity_info->disabled_components;
+    entity_info->disabled_components = disabled_components;
+    if (update_inactive_bit(world, entity_info) != ECS_OK)
+    {
+        entity_info->disabled_components = old_disabled_components;
+        return ECS_ERR_MEM;
+    }
+    update_enabled_bits(world, entity_info);
+
+    return ECS_OK;
+}
+
+bool ecs_world_is_component_enabled_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name)
+{
+    int entity_ind, comp_info_id;
+    if (!sparse_map_get(&world->entity_to_index_map, entity, &entity_ind) ||
+            !stoi_map_get(&world->component_name_to_index_map, name, &comp_info_id))
+    {
+        return false;
+    }
+
+    entity_info_t *entity_info;
+    vector_get(&world->entities, entity_ind, (void **)&entity_info);
+
+    return (entity_info->signature & ~entity_info->disabled_components & (1 << comp_info_id)) != 0;
+}
+
+ecs_err_t ecs_world_register_buffer_by_name(ecs_world_t *world, const char *name, size_t element_size, int inline_capacity)
+{
+    if (element_size == 0 || inline_capacity < 0 || world->forked)
+    {
+        return ECS_ERR;
+    }
+
+    buffer_info_t *buffer = malloc(sizeof(buffer_info_t));
+    if (buffer == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // Inline elements follow the header, aligned as pool blocks
+    size_t size = sizeof(buffer_header_t) + inline_capacity * element_size;
+    size = (size + BLOCK_POOL_ALIGN - 1) & ~(size_t)(BLOCK_POOL_ALIGN - 1);
+    ecs_err_t ret = ecs_world_register_component_by_name(world, name, size);
+    if (ret != ECS_OK)
+    {
+        free(buffer);
+        return ret;
+    }
+
+    int comp_info_ind;
+    stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind);
+    *buffer = (buffer_info_t){ .element_size=element_size, .inline_capacity=inline_capacity };
+    block_pool_init(&buffer->pool);
+    world->components[comp_info_ind].buffer = buffer;
+
+    return ECS_OK;
+}
+
+void free_buffer_info(component_info_t *comp_info)
+{
+    if (comp_info->buffer)
+    {
+        block_pool_destroy(&comp_info->buffer->pool);
+        free(comp_info->buffer);
+        comp_info->buffer = NULL;
+    }
+}
+
+static inline void *buffer_data(buffer_info_t *buffer, buffer_header_t *header)
+{
+    return header->size_class ? block_pool_get(&buffer->pool, header->block) : header + 1;
+}
+
+void release_buffer(component_info_t *comp_info, void *comp)
+{
+    buffer_header_t *header = comp;
+    if (header->size_class)
+    {
+        block_pool_free(&comp_info->buffer->pool, header->size_class, header->block);
+    }
+    *header = (buffer_header_t){ 0 };
+}
+
+// Buffer slot of the entity, added when missing and `add` is set
+static ecs_err_t get_buffer_slot(ecs_world_t *world, ecs_entity_t entity, const char *name, bool add, component_info_t **comp_info, buffer_header_t **header)
+{
+    int comp_info_ind, comp_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind) || world->components[comp_info_ind].buffer == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    *comp_info = &world->components[comp_info_ind];
+    if (!sparse_map_get(&(*comp_info)->entity_to_index_map, entity, &comp_ind))
+    {
+        if (!add)
+        {
+            return ECS_ERR_NULL;
+        }
+
+        ecs_err_t ret = ecs_world_add_component_by_name(world, entity, name, NULL);
+        if (ret != ECS_OK)
+        {
+            return ret;
+        }
+        sparse_map_get(&(*comp_info)->entity_to_index_map, entity, &comp_ind);
+    }
+
+    vector_get(&(*comp_info)->array, comp_ind, (void **)header);
+    mark_chunks_stale(*comp_info, comp_ind, 1);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_buffer_append_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, const void *values, int count)
+{
+    component_info_t *comp_info;
+    buffer_header_t *header;
+    if (count < 0)
+    {
+        return ECS_ERR;
+    }
+    ecs_err_t ret = get_buffer_slot(world, entity, name, true, &comp_info, &header);
+    if (ret != ECS_OK)
+    {
+        return ret;
+    }
+
+    buffer_info_t *buffer = comp_info->buffer;
+    int new_count = header->count + count;
+    int capacity = header->size_class ? 1 << header->size_class : buffer->inline_capacity;
+    if (new_count > capacity)
+    {
+        // Spill to the smallest class holding the elements, doubling at least
+        int size_class = header->size_class ? header->size_class + 1 : 1;
+        while ((1 << size_class) < new_count || (1 << size_class) <= buffer->inline_capacity)
+        {
+            if (++size_class >= BLOCK_POOL_CLASSES - 1)
+            {
+                return ECS_ERR_MEM;
+            }
+        }
+
+        size_t block;
+        if (block_pool_alloc(&buffer->pool, size_class, ((size_t)1 << size_class) * buffer->element_size, &block))
+        {
+            return ECS_ERR_MEM;
+        }
+        memcpy(block_pool_get(&buffer->pool, block), buffer_data(buffer, header), header->count * buffer->element_size);
+        if (header->size_class && block_pool_free(&buffer->pool, header->size_class, header->block))
+        {
+            block_pool_free(&buffer->pool, size_class, block);
+            return ECS_ERR_MEM;
+        }
+        header->size_class = size_class;
+        header->block = block;
+    }
+
+    memcpy((char *)buffer_data(buffer, header) + header->count * buffer->element_size, values, count * buffer->element_size);
+    header->count = new_count;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_buffer_clear_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name)
+{
+    component_info_t *comp_info;
+    buffer_header_t *header;
+    ecs_err_t ret = get_buffer_slot(world, entity, name, false, &comp_info, &header);
+    if (ret != ECS_OK)
+    {
+        return ret;
+    }
+
+    release_buffer(comp_info, header);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_buffer_get_by_name(ecs_world_t *world, ecs_entity_t entity, const char *name, void **data, int *count)
+{
+    component_info_t *comp_info;
+    buffer_header_t *header;
+    ecs_err_t ret = get_buffer_slot(world, entity, name, false, &comp_info, &header);
+    if (ret != ECS_OK)
+    {
+        return ret;
+    }
+
+    *data = buffer_data(comp_info->buffer, header);
+    *count = header->count;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_create_prefab(ecs_world_t *world, ecs_prefab_t *prefab, ecs_entity_t entity)
+{
+    int entity_ind;
+    if (!sparse_map_get(&world->entity_to_index_map, entity, &entity_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    entity_info_t *entity_info;
+    vector_get(&world->entities, entity_ind, (void **)&entity_info);
+
+    // Reuse a freed prefab slot if any
+    int prefab_ind = world->prefabs.size;
+    for (int i = 0; i < world->prefabs.size; ++i)
+    {
+        prefab_info_t *info;
+        vector_get(&world->prefabs, i, (void **)&info);
+        if (!info->used)
+        {
+            prefab_ind = i;
+            break;
+        }
+    }
+    if (prefab_ind == world->prefabs.size && vector_push_back(&world->prefabs, &(prefab_info_t){ 0 }))
+    {
+        return ECS_ERR_MEM;
+    }
+
+    prefab_info_t *prefab_info;
+    vector_get(&world->prefabs, prefab_ind, (void **)&prefab_info);
+    memset(prefab_info, 0, sizeof(prefab_info_t));
+    prefab_info->used = true;
+    prefab_info->signature = entity_info->signature;
+
+    // Capture the component values of the template entity
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (!(entity_info->signature & (1 << i)))
+        {
+            continue;
+        }
+
+        component_info_t *comp_info = &world->components[i];
+        int comp_ind;
+        void *comp;
+        sparse_map_get(&comp_info->entity_to_index_map, entity, &comp_ind);
+        vector_get(&comp_info->array, comp_ind, &comp);
+
+        prefab_info->values[i] = malloc(comp_info->array.element_size);
+        if (prefab_info->values[i] == NULL)
+        {
+            ecs_world_free_prefab(world, prefab_ind + 1);
+            return ECS_ERR_MEM;
+        }
+        if (comp_info->hooks.copy)
+        {
+            comp_info->hooks.copy(prefab_info->values[i], comp, 1);
+        }
+        else if (comp_info->buffer)
+        {
+            // Instances get empty buffers
+            memset(prefab_info->values[i], 0, comp_info->array.element_size);
+        }
+        else
+        {
+            memcpy(prefab_info->values[i], comp, comp_info->array.element_size);
+        }
+    }
+
+    *prefab = prefab_ind + 1;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_free_prefab(ecs_world_t *world, ecs_prefab_t prefab)
+{
+    if (prefab == 0 || prefab > world->prefabs.size)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    prefab_info_t *prefab_info;
+    vector_get(&world->prefabs, prefab - 1, (void **)&prefab_info);
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (prefab_info->values[i] && world->components[i].hooks.dtor)
+        {
+            world->components[i].hooks.dtor(prefab_info->values[i], 1);
+        }
+        free(prefab_info->values[i]);
+        prefab_info->values[i] = NULL;
+    }
+    prefab_info->used = false;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_instantiate(ecs_world_t *world, ecs_prefab_t prefab, int count, ecs_entity_t *entities)
+{
+    if (prefab == 0 || prefab > world->prefabs.size || count < 0)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    prefab_info_t *prefab_info;
+    vector_get(&world->prefabs, prefab - 1, (void **)&prefab_info);
+    if (!prefab_info->used)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    if (count == 0)
+    {
+        return ECS_OK;
+    }
+
+    if (flush_reserved_entities(world) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // Reserve every array and map up front, new ids being below max_entity,
+    // so that only the value indices can fail once the batch started
+    int first_entity_ind = world->entities.size;
+    ecs_entity_t max_entity = world->next_entities + count - 1;
+    if (vector_reserve_size(&world->entities, first_entity_ind + count) ||
+            sparse_map_reserve(&world->entity_to_index_map, max_entity))
+    {
+        return ECS_ERR_MEM;
+    }
+
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (prefab_info->signature & (1 << i))
+        {
+            component_info_t *comp_info = &world->components[i];
+            if (pool_reserve(comp_info, comp_info->array.size + count) != ECS_OK ||
+                    vector_reserve_size(&comp_info->entities, comp_info->entities.size + count) ||
+                    sparse_map_reserve(&comp_info->entity_to_index_map, max_entity))
+            {
+                return ECS_ERR_MEM;
+            }
+        }
+    }
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        if (query_info->used && query_matches(query_info, prefab_info->signature) &&
+                (vector_reserve_size(&query_info->entities, query_info->entities.size + count) ||
+                 sparse_map_reserve(&query_info->entity_to_index_map, max_entity)))
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    // Allocate the entities
+    journal_write(&world->entities_journal, &world->entities, first_entity_ind, count);
+    entity_info_t *entity_infos = (entity_info_t *)world->entities.data + first_entity_ind;
+    for (int i = 0; i < count; ++i)
+    {
+        entities[i] = next_entity_id(world);
+        entity_infos[i] = (entity_info_t){ .entity=entities[i], .signature=prefab_info->signature };
+        sparse_map_insert(&world->entity_to_index_map, entities[i], first_entity_ind + i);
+    }
+    world->entities.size += count;
+
+    // Copy every component column at once
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (!(prefab_info->signature & (1 << i)))
+        {
+            continue;
+        }
+
+        component_info_t *comp_info = &world->components[i];
+        size_t element_size = comp_info->array.element_size;
+        int first_comp_ind = comp_info->array.size;
+        char *dst = (char *)comp_info->array.data + first_comp_ind * element_size;
+        journal_write(&comp_info->array_journal, &comp_info->array, first_comp_ind, count);
+        journal_write(&comp_info->entities_journal, &comp_info->entities, first_comp_ind, count);
+        mark_chunks_stale(comp_info, first_comp_ind, count);
+
+        if (comp_info->hooks.copy)
+        {
+            for (int j = 0; j < count; ++j)
+            {
+                comp_info->hooks.copy(dst + j * element_size, prefab_info->values[i], 1);
+            }
+        }
+        else
+        {
+            // Fill by doubling the already copied range
+            memcpy(dst, prefab_info->values[i], element_size);
+            for (int copied = 1; copied < count; copied *= 2)
+            {
+                int n = copied < count - copied ? copied : count - copied;
+                memcpy(dst + copied * element_size, dst, n * element_size);
+            }
+        }
+
+        memcpy((ecs_entity_t *)comp_info->entities.data + first_comp_ind, entities, count * sizeof(ecs_entity_t));
+        for (int j = 0; j < count; ++j)
+        {
+            sparse_map_insert(&comp_info->entity_to_index_map, entities[j], first_comp_ind + j);
+        }
+
+        comp_info->array.size += count;
+        comp_info->entities.size += count;
+        comp_info->key_sorted = false;
+        sync_previous_slots(comp_info, first_comp_ind);
+    }
+
+    // Insert the whole batch into the matching queries
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        if (!query_info->used || !query_matches(query_info, prefab_info->signature))
+        {
+            continue;
+        }
+
+        int first_ind = query_info->entities.size;
+        journal_write(&query_info->entities_journal, &query_info->entities, first_ind, count);
+        vector_resize(&query_info->entities, first_ind + count);
+        memcpy((ecs_entity_t *)query_info->entities.data + first_ind, entities, count * sizeof(ecs_entity_t));
+        for (int j = 0; j < count; ++j)
+        {
+            sparse_map_insert(&query_info->entity_to_index_map, entities[j], first_ind + j);
+        }
+        query_info->enabled_stale = true;
+    }
+
+    // The batch is undone when a value index runs out of memory
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        component_info_t *comp_info = &world->components[i];
+        if ((prefab_info->signature & (1 << i)) && index_components(world, i, comp_info->array.size - count, count) != ECS_OK)
+        {
+            for (int j = count - 1; j >= 0; --j)
+            {
+                delete_entity(world, entities[j], true);
+            }
+            return ECS_ERR_MEM;
+        }
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_move_entities(ecs_world_t *src, ecs_world_t *dst, const ecs_entity_t *entities, int count, ecs_entity_t *out)
+{
+    if (src == dst || count < 0)
+    {
+        return ECS_ERR;
+    }
+    if (flush_reserved_entities(src) != ECS_OK || flush_reserved_entities(dst) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // Pools are matched by name and must have the same layout
+    int comp_map[ECS_MAX_COMPONENTS];
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        comp_map[i] = -1;
+    }
+    for (stoi_map_entry_t *entry = src->component_name_to_index_map.entries; entry; entry = entry->hh.next)
+    {
+        int dst_ind;
+        component_info_t *comp_info = &src->components[entry->value];
+        if (stoi_map_get(&dst->component_name_to_index_map, entry->key, &dst_ind) &&
+                dst->components[dst_ind].array.element_size == comp_info->array.element_size &&
+                (dst->components[dst_ind].buffer == NULL) == (comp_info->buffer == NULL))
+        {
+            comp_map[entry->value] = dst_ind;
+        }
+    }
+
+    // Every entity is checked before anything changes. Entities in a
+    // hierarchy must be detached roots.
+    uint64_t *seen = calloc(src->next_entities / 64 + 1, sizeof(uint64_t));
+    if (seen == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+    ecs_signature_t used = 0;
+    ecs_err_t ret = ECS_OK;
+    for (int i = 0; i < count && ret == ECS_OK; ++i)
+    {
+        int entity_ind, pos;
+        ecs_entity_t entity = entities[i];
+        if (!sparse_map_get(&src->entity_to_index_map, entity, &entity_ind) || (seen[entity / 64] & (1ull << (entity % 64))))
+        {
+            ret = ECS_ERR_NULL;
+            break;
+        }
+        seen[entity / 64] |= 1ull << (entity % 64);
+
+        entity_info_t *entity_info = (entity_info_t *)src->entities.data + entity_ind;
+        used |= entity_info->signature;
+        if (sparse_map_get(&src->hierarchy.parents, entity, NULL) ||
+                (sparse_map_get(&src->hierarchy.positions, entity, &pos) && ((int *)src->hierarchy.sizes.data)[pos] > 1))
+        {
+            ret = ECS_ERR;
+        }
+    }
+    free(seen);
+    for (int i = 0; i < ECS_MAX_COMPONENTS && ret == ECS_OK; ++i)
+    {
+        if ((used & (1 << i)) && comp_map[i] < 0)
+        {
+            ret = ECS_ERR;
+        }
+    }
+    if (ret != ECS_OK || count == 0)
+    {
+        return ret;
+    }
+
+    // Everything that can fail is reserved before the source changes: the
+    // destination arrays, maps and queries, the blocks of spilled buffers
+    // and the removal from the source. Only indexing, which leaves the
+    // destination to ecs_reindex_component, can still fail.
+    int buffer_count = 0;
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        buffer_count += (used & (1 << i)) && src->components[i].buffer != NULL;
+    }
+    ecs_signature_t *signatures = malloc(count * sizeof(ecs_signature_t));
+    uint64_t *keys = malloc(count * sizeof(uint64_t));
+    size_t *blocks = malloc(count * buffer_count * sizeof(size_t) + 1);
+    if (signatures == NULL || keys == NULL || blocks == NULL)
+    {
+        free(signatures);
+        free(keys);
+        free(blocks);
+        return ECS_ERR_MEM;
+    }
+
+    int max_entity = dst->next_entities + count;
+    bool inactive = false;
+    for (int i = 0; i < count; ++i)
+    {
+        int entity_ind;
+        sparse_map_get(&src->entity_to_index_map, entities[i], &entity_ind);
+        entity_info_t *entity_info = (entity_info_t *)src->entities.data + entity_ind;
+        signatures[i] = 0;
+        for (int j = 0; j < ECS_MAX_COMPONENTS; ++j)
+        {
+            if (entity_info->signature & (1 << j))
+            {
+                signatures[i] |= 1 << comp_map[j];
+            }
+        }
+        inactive |= entity_info->disabled || entity_info->disabled_components;
+    }
+
+    int first_entity_ind = dst->entities.size;
+    int ret_reserve = vector_reserve_size(&src->recycled_entities, src->recycled_entities.size + count);
+    ret_reserve |= vector_reserve_size(&dst->entities, first_entity_ind + count);
+    ret_reserve |= sparse_map_reserve(&dst->entity_to_index_map, max_entity);
+    if (inactive && dst->inactive_entities.size < max_entity / 64 + 1)
+    {
+        int old_size = dst->inactive_entities.size;
+        ret_reserve |= vector_resize(&dst->inactive_entities, max_entity / 64 + 1);
+        if (dst->inactive_entities.size > old_size)
+        {
+            memset((uint64_t *)dst->inactive_entities.data + old_size, 0, (dst->inactive_entities.size - old_size) * sizeof(uint64_t));
+        }
+    }
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (used & (1 << i))
+        {
+            component_info_t *comp_info = &dst->components[comp_map[i]];
+            int size = comp_info->array.size;
+            ret_reserve |= pool_reserve(comp_info, size + count) != ECS_OK;
+            ret_reserve |= vector_reserve_size(&comp_info->entities, size + count);
+            ret_reserve |= sparse_map_reserve(&comp_info->entity_to_index_map, max_entity);
+            ret_reserve |= comp_info->double_buffered && vector_reserve_size(&comp_info->previous, size + count);
+        }
+    }
+    for (int i = 0; i < dst->queries.size; ++i)
+    {
+        query_info_t *query_info = (query_info_t *)dst->queries.data + i;
+        int matched = 0;
+        for (int j = 0; query_info->used && j < count; ++j)
+        {
+            matched += query_matches(query_info, signatures[j]);
+        }
+        if (matched > 0)
+        {
+            ret_reserve |= vector_reserve_size(&query_info->entities, query_info->entities.size + matched);
+            ret_reserve |= sparse_map_reserve(&query_info->entity_to_index_map, max_entity);
+        }
+    }
+
+    // Blocks of spilled buffers, buffer by buffer
+    int block_count = 0;
+    for (int i = 0; i < ECS_MAX_COMPONENTS && !ret_reserve; ++i)
+    {
+        component_info_t *src_info = &src->components[i];
+        if (!(used & (1 << i)) || src_info->buffer == NULL)
+        {
+            continue;
+        }
+
+        buffer_info_t *buffer = dst->components[comp_map[i]].buffer;
+        for (int j = 0; j < count && !ret_reserve; ++j)
+        {
+            int comp_ind;
+            buffer_header_t *header = NULL;
+            if (sparse_map_get(&src_info->entity_to_index_map, entities[j], &comp_ind))
+            {
+                header = (buffer_header_t *)((char *)src_info->array.data + comp_ind * src_info->array.element_size);
+            }
+            if (header && header->size_class)
+            {
+                ret_reserve = block_pool_alloc(&buffer->pool, header->size_class, ((size_t)1 << header->size_class) * buffer->element_size, &blocks[block_count]);
+            }
+            block_count += !ret_reserve;
+        }
+    }
+    if (ret_reserve)
+    {
+        // Blocks already taken are given back, in the same order
+        for (int i = 0, b = 0; i < ECS_MAX_COMPONENTS && b < block_count; ++i)
+        {
+            component_info_t *src_info = &src->components[i];
+            if (!(used & (1 << i)) || src_info->buffer == NULL)
+            {
+                continue;
+            }
+            for (int j = 0; j < count && b < block_count; ++j, ++b)
+            {
+                int comp_ind;
+                buffer_header_t *header = NULL;
+                if (sparse_map_get(&src_info->entity_to_index_map, entities[j], &comp_ind))
+                {
+                    header = (buffer_header_t *)((char *)src_info->array.data + comp_ind * src_info->array.element_size);
+                }
+                if (header && header->size_class)
+                {
+                    block_pool_free(&dst->components[comp_map[i]].buffer->pool, header->size_class, blocks[b]);
+                }
+            }
+        }
+        free(signatures);
+        free(keys);
+        free(blocks);
+        return ECS_ERR_MEM;
+    }
+
+    // Allocate the entities with their signatures in destination ids
+    journal_write(&dst->entities_journal, &dst->entities, first_entity_ind, count);
+    dst->entities.size = first_entity_ind + count;
+    entity_info_t *entity_infos = (entity_info_t *)dst->entities.data + first_entity_ind;
+    for (int i = 0; i < count; ++i)
+    {
+        int entity_ind;
+        sparse_map_get(&src->entity_to_index_map, entities[i], &entity_ind);
+        entity_info_t *entity_info = (entity_info_t *)src->entities.data + entity_ind;
+
+        out[i] = next_entity_id(dst);
+        entity_infos[i] = (entity_info_t){ .entity=out[i], .signature=signatures[i], .disabled=entity_info->disabled };
+        for (int j = 0; j < ECS_MAX_COMPONENTS; ++j)
+        {
+            if (entity_info->disabled_components & (1 << j))
+            {
+                entity_infos[i].disabled_components |= 1 << comp_map[j];
+            }
+        }
+        sparse_map_insert(&dst->entity_to_index_map, out[i], first_entity_ind + i);
+        update_inactive_bit(dst, &entity_infos[i]);
+    }
+
+    // Relocate column by column, source slots are left to be dropped
+    block_count = 0;
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (!(used & (1 << i)))
+        {
+            continue;
+        }
+
+        component_info_t *src_info = &src->components[i];
+        component_info_t *dst_info = &dst->components[comp_map[i]];
+        size_t element_size = dst_info->array.element_size;
+        int first_comp_ind = dst_info->array.size;
+        int moved = 0;
+        for (int j = 0; j < count; ++j)
+        {
+            moved += (signatures[j] & (1 << comp_map[i])) != 0;
+        }
+        journal_write(&dst_info->array_journal, &dst_info->array, first_comp_ind, moved);
+        journal_write(&dst_info->entities_journal, &dst_info->entities, first_comp_ind, moved);
+        mark_chunks_stale(dst_info, first_comp_ind, moved);
+
+        moved = 0;
+        for (int j = 0; j < count; ++j, block_count += src_info->buffer != NULL)
+        {
+            int comp_ind;
+            if (!sparse_map_get(&src_info->entity_to_index_map, entities[j], &comp_ind))
+            {
+                continue;
+            }
+
+            void *from = (char *)src_info->array.data + comp_ind * element_size;
+            void *to = (char *)dst_info->array.data + (first_comp_ind + moved) * element_size;
+            if (src_info->hooks.move)
+            {
+                src_info->hooks.move(to, from, 1);
+            }
+            else
+            {
+                memcpy(to, from, element_size);
+            }
+
+            // Spilled buffer elements change pool
+            buffer_header_t *header = to;
+            if (dst_info->buffer && header->size_class)
+            {
+                size_t block = header->block;
+                header->block = blocks[block_count];
+                memcpy(block_pool_get(&dst_info->buffer->pool, header->block), block_pool_get(&src_info->buffer->pool, block), header->count * dst_info->buffer->element_size);
+                block_pool_free(&src_info->buffer->pool, header->size_class, block);
+            }
+
+            ((ecs_entity_t *)dst_info->entities.data)[first_comp_ind + moved] = out[j];
+            sparse_map_insert(&dst_info->entity_to_index_map, out[j], first_comp_ind + moved);
+            ++moved;
+        }
+
+        dst_info->array.size += moved;
+        dst_info->entities.size += moved;
+        dst_info->key_sorted &= moved == 0;
+        sync_previous_slots(dst_info, first_comp_ind);
+        ret |= index_components(dst, comp_map[i], first_comp_ind, moved);
+    }
+
+    // Append the batch to the matching destination queries
+    for (int i = 0; i < dst->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&dst->queries, i, (void **)&query_info);
+        if (!query_info->used)
+        {
+            continue;
+        }
+
+        int first_ind = query_info->entities.size;
+        int matched = 0;
+        for (int j = 0; j < count; ++j)
+        {
+            matched += query_matches(query_info, signatures[j]);
+        }
+        journal_write(&query_info->entities_journal, &query_info->entities, first_ind, matched);
+        query_info->entities.size = first_ind + matched;
+
+        ecs_entity_t *query_entities = (ecs_entity_t *)query_info->entities.data + first_ind;
+        for (int j = 0, k = 0; j < count; ++j)
+        {
+            if (query_matches(query_info, signatures[j]))
+            {
+                query_entities[k] = out[j];
+                sparse_map_insert(&query_info->entity_to_index_map, out[j], first_ind + k++);
+            }
+        }
+        query_info->enabled_stale = true;
+    }
+
+    // The source rows go in one batch, relocated slots without destruction
+    remove_entities(src, entities, count, false, keys);
+    free(signatures);
+    free(keys);
+    free(blocks);
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+ecs_err_t ecs_world_set_resource_by_name(ecs_world_t *world, const char *name, void *value)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (comp_info->resource == NULL)
+    {
+        comp_info->resource = calloc(1, comp_info->array.element_size);
+        if (comp_info->resource == NULL)
+        {
+            return ECS_ERR_MEM;
+        }
+        if (comp_info->hooks.ctor)
+        {
+            comp_info->hooks.ctor(comp_info->resource, 1);
+        }
+    }
+
+    if (value)
+    {
+        if (comp_info->hooks.dtor)
+        {
+            comp_info->hooks.dtor(comp_info->resource, 1);
+        }
+        if (comp_info->hooks.copy)
+        {
+            comp_info->hooks.copy(comp_info->resource, value, 1);
+        }
+        else
+        {
+            memcpy(comp_info->resource, value, comp_info->array.element_size);
+        }
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_get_resource_by_name(ecs_world_t *world, const char *name, void **dest)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (comp_info->resource == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    *dest = comp_info->resource;
+
+    return ECS_OK;
+}
+
+void free_event_channel(component_info_t *comp_info)
+{
+    if (comp_info->channel == NULL)
+    {
+        return;
+    }
+
+    mpmc_ring_free(&comp_info->channel->rings[0]);
+    mpmc_ring_free(&comp_info->channel->rings[1]);
+    free(comp_info->channel);
+    comp_info->channel = NULL;
+}
+
+void flip_event_channel(event_channel_t *channel)
+{
+    // Events left from the previous pass are dropped
+    mpmc_ring_clear(&channel->rings[channel->current ^ 1]);
+    channel->current ^= 1;
+}
+
+ecs_err_t ecs_world_register_event_channel_by_name(ecs_world_t *world, const char *name, int capacity)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (comp_info->channel != NULL)
+    {
+        return ECS_ERR_EXISTS;
+    }
+    if (capacity <= 0)
+    {
+        return ECS_ERR;
+    }
+
+    event_channel_t *channel = calloc(1, sizeof(event_channel_t));
+    if (channel == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+    if (mpmc_ring_init(&channel->rings[0], comp_info->array.element_size, capacity)
+            || mpmc_ring_init(&channel->rings[1], comp_info->array.element_size, capacity))
+    {
+        mpmc_ring_free(&channel->rings[0]);
+        free(channel);
+        return ECS_ERR_MEM;
+    }
+    comp_info->channel = channel;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_publish_events_by_name(ecs_world_t *world, const char *name, const void *events, int count)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    event_channel_t *channel = world->components[comp_info_ind].channel;
+    if (channel == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    // A full channel keeps the events published so far
+    if (mpmc_ring_push(&channel->rings[channel->current], events, count) < count)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_consume_events_by_name(ecs_world_t *world, const char *name, void *dest, int max, int *count)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    event_channel_t *channel = world->components[comp_info_ind].channel;
+    if (channel == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    // Oldest events first
+    int n = mpmc_ring_pop(&channel->rings[channel->current ^ 1], dest, max);
+    n += mpmc_ring_pop(&channel->rings[channel->current], (char *)dest + n * channel->rings[0].element_size, max - n);
+    *count = n;
+
+    return ECS_OK;
+}
+
+uint64_t encode_key(ecs_key_type_t type, size_t size, const void *value)
+{
+    // Keys are mapped to unsigned integers sorting in the same order
+    const uint64_t sign = 1ull << 63;
+    switch (type)
+    {
+        case ECS_KEY_INT:
+        {
+            int64_t v = 0;
+            switch (size)
+            {
+                case 1: { int8_t x; memcpy(&x, value, 1); v = x; break; }
+                case 2: { int16_t x; memcpy(&x, value, 2); v = x; break; }
+                case 4: { int32_t x; memcpy(&x, value, 4); v = x; break; }
+                case 8: { memcpy(&v, value, 8); break; }
+            }
+            return (uint64_t)v ^ sign;
+        }
+        case ECS_KEY_UINT:
+        {
+            uint64_t v = 0;
+            switch (size)
+            {
+                case 1: { uint8_t x; memcpy(&x, value, 1); v = x; break; }
+                case 2: { uint16_t x; memcpy(&x, value, 2); v = x; break; }
+                case 4: { uint32_t x; memcpy(&x, value, 4); v = x; break; }
+                case 8: { memcpy(&v, value, 8); break; }
+            }
+            return v;
+        }
+        case ECS_KEY_FLOAT:
+        {
+            double d;
+            if (size == 4)
+            {
+                float f;
+                memcpy(&f, value, 4);
+                d = f;
+            }
+            else
+            {
+                memcpy(&d, value, 8);
+            }
+
+            // Negative values sort reversed
+            uint64_t bits;
+            memcpy(&bits, &d, 8);
+            return bits & sign ? ~bits : bits | sign;
+        }
+        default:
+            return 0;
+    }
+}
+
+static bool is_valid_key(ecs_key_type_t type, size_t size)
+{
+    if (type == ECS_KEY_FLOAT)
+    {
+        return size == 4 || size == 8;
+    }
+
+    return (type == ECS_KEY_INT || type == ECS_KEY_UINT) && (size == 1 || size == 2 || size == 4 || size == 8);
+}
+
+static inline uint64_t hash_key(uint64_t key)
+{
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+
+    return key;
+}
+
+static int find_index_bucket(index_info_t *index_info, uint64_t key)
+{
+    int mask = index_info->bucket_capacity - 1;
+    int bucket = hash_key(key) & mask;
+    while (index_info->buckets[bucket].group != -1 && index_info->buckets[bucket].key != key)
+    {
+        bucket = (bucket + 1) & mask;
+    }
+
+    return bucket;
+}
+
+static ecs_err_t resize_index_buckets(index_info_t *index_info, int capacity)
+{
+    int old_capacity = index_info->bucket_capacity;
+    index_bucket_t *old_buckets = index_info->buckets;
+
+    index_bucket_t *buckets = malloc(capacity * sizeof(index_bucket_t));
+    if (buckets == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+    for (int i = 0; i < capacity; ++i)
+    {
+        buckets[i].group = -1;
+    }
+
+    index_info->buckets = buckets;
+    index_info->bucket_capacity = capacity;
+    for (int i = 0; i < old_capacity; ++i)
+    {
+        if (old_buckets[i].group != -1)
+        {
+            buckets[find_index_bucket(index_info, old_buckets[i].key)] = old_buckets[i];
+        }
+    }
+    free(old_buckets);
+
+    return ECS_OK;
+}
+
+static index_group_t *get_index_group(index_info_t *index_info, uint64_t key, bool create)
+{
+    if (index_info->bucket_capacity > 0)
+    {
+        int group = index_info->buckets[find_index_bucket(index_info, key)].group;
+        if (group != -1)
+        {
+            return (index_group_t *)index_info->groups.data + group;
+        }
+    }
+    if (!create)
+    {
+        return NULL;
+    }
+
+    // Load factor under 1/2
+    if ((index_info->groups.size + 1) * 2 > index_info->bucket_capacity &&
+            resize_index_buckets(index_info, index_info->bucket_capacity ? index_info->bucket_capacity * 2 : 16) != ECS_OK)
+    {
+        return NULL;
+    }
+
+    index_group_t group = { .key=key };
+    if (vector_init(&group.entities, sizeof(ecs_entity_t), 1) || vector_push_back(&index_info->groups, &group))
+    {
+        vector_free(&group.entities);
+        return NULL;
+    }
+    index_info->buckets[find_index_bucket(index_info, key)] = (index_bucket_t){ .key=key, .group=index_info->groups.size - 1 };
+
+    return (index_group_t *)index_info->groups.data + index_info->groups.size - 1;
+}
+
+// Frees an emptied group, the last group takes its place and the bucket is
+// removed by shifting the rest of its probe run back
+static void remove_index_group(index_info_t *index_info, uint64_t key)
+{
+    int mask = index_info->bucket_capacity - 1;
+    int bucket = find_index_bucket(index_info, key);
+    int group = index_info->buckets[bucket].group;
+
+    index_group_t *groups = index_info->groups.data;
+    vector_free(&groups[group].entities);
+    int last_group = --index_info->groups.size;
+    if (group != last_group)
+    {
+        groups[group] = groups[last_group];
+        index_info->buckets[find_index_bucket(index_info, groups[group].key)].group = group;
+    }
+
+    for (int next = (bucket + 1) & mask; index_info->buckets[next].group != -1; next = (next + 1) & mask)
+    {
+        // Entries whose home lies cyclically in (bucket, next] stay put
+        int home = hash_key(index_info->buckets[next].key) & mask;
+        if (((next - home) & mask) >= ((next - bucket) & mask))
+        {
+            index_info->buckets[bucket] = index_info->buckets[next];
+            bucket = next;
+        }
+    }
+    index_info->buckets[bucket].group = -1;
+}
+
+static ecs_err_t index_insert(index_info_t *index_info, ecs_entity_t entity, uint64_t key)
+{
+    if (index_info->entity_keys.size <= (int)entity)
+    {
+        if (vector_resize(&index_info->entity_keys, entity + 1))
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+    ((uint64_t *)index_info->entity_keys.data)[entity] = key;
+
+    vector_t *entries;
+    if (index_info->kind == ECS_INDEX_HASH)
+    {
+        index_group_t *group = get_index_group(index_info, key, true);
+        if (group == NULL || vector_push_back(&group->entities, &entity))
+        {
+            return ECS_ERR_MEM;
+        }
+        entries = &group->entities;
+    }
+    else
+    {
+        if (vector_push_back(&index_info->pending, &(index_entry_t){ .key=key, .entity=entity }))
+        {
+            return ECS_ERR_MEM;
+        }
+        entries = &index_info->pending;
+    }
+
+    return sparse_map_insert(&index_info->entity_to_slot_map, entity, entries->size - 1) ? ECS_ERR_MEM : ECS_OK;
+}
+
+static void index_remove(index_info_t *index_info, ecs_entity_t entity)
+{
+    int slot;
+    if (!sparse_map_get(&index_info->entity_to_slot_map, entity, &slot))
+    {
+        return;
+    }
+    sparse_map_remove(&index_info->entity_to_slot_map, entity);
+    uint64_t key = ((uint64_t *)index_info->entity_keys.data)[entity];
+
+    if (index_info->kind == ECS_INDEX_HASH)
+    {
+        // Swap the last entity of the group into the hole
+        index_group_t *group = get_index_group(index_info, key, false);
+        ecs_entity_t *entities = group->entities.data;
+        int last_slot = --group->entities.size;
+        if (slot != last_slot)
+        {
+            entities[slot] = entities[last_slot];
+            sparse_map_insert(&index_info->entity_to_slot_map, entities[slot], slot);
+        }
+        if (last_slot == 0)
+        {
+            remove_index_group(index_info, key);
+        }
+    }
+    else if (slot != INDEX_SORTED)
+    {
+        index_entry_t *pending = index_info->pending.data;
+        int last_slot = --index_info->pending.size;
+        if (slot != last_slot)
+        {
+            pending[slot] = pending[last_slot];
+            sparse_map_insert(&index_info->entity_to_slot_map, pending[slot].entity, slot);
+        }
+    }
+    else
+    {
+        // Removal from the sorted arrays is deferred to the next merge
+        ++index_info->tombstones;
+    }
+}
+
+static int compare_index_entries(const void *a, const void *b)
+{
+    const index_entry_t *ea = a, *eb = b;
+    if (ea->key != eb->key)
+    {
+        return ea->key < eb->key ? -1 : 1;
+    }
+
+    return (ea->entity > eb->entity) - (ea->entity < eb->entity);
+}
+
+static ecs_err_t flush_ordered_index(index_info_t *index_info)
+{
+    uint64_t *keys = index_info->sorted_keys.data;
+    ecs_entity_t *entities = index_info->sorted_entities.data;
+    if (index_info->tombstones > 0)
+    {
+        int size = 0;
+        for (int i = 0; i < index_info->sorted_keys.size; ++i)
+        {
+            int slot;
+            if (sparse_map_get(&index_info->entity_to_slot_map, entities[i], &slot) && slot == INDEX_SORTED)
+            {
+                keys[size] = keys[i];
+                entities[size++] = entities[i];
+            }
+        }
+        index_info->sorted_keys.size = size;
+        index_info->sorted_entities.size = size;
+        index_info->tombstones = 0;
+    }
+
+    int pending_count = index_info->pending.size;
+    if (pending_count == 0)
+    {
+        return ECS_OK;
+    }
+
+    // Sort the pending entries and merge them from the back
+    index_entry_t *pending = index_info->pending.data;
+    qsort(pending, pending_count, sizeof(index_entry_t), compare_index_entries);
+
+    int i = index_info->sorted_keys.size - 1;
+    int j = pending_count - 1;
+    int size = index_info->sorted_keys.size + pending_count;
+    if (vector_resize(&index_info->sorted_keys, size) || vector_resize(&index_info->sorted_entities, size))
+    {
+        index_info->sorted_keys.size = i + 1;
+        index_info->sorted_entities.size = i + 1;
+        return ECS_ERR_MEM;
+    }
+    keys = index_info->sorted_keys.data;
+    entities = index_info->sorted_entities.data;
+    for (int k = size - 1; j >= 0; --k)
+    {
+        if (i >= 0 && (keys[i] > pending[j].key || (keys[i] == pending[j].key && entities[i] > pending[j].entity)))
+        {
+            keys[k] = keys[i];
+            entities[k] = entities[i--];
+        }
+        else
+        {
+            keys[k] = pending[j].key;
+            entities[k] = pending[j--].entity;
+        }
+    }
+
+    for (int k = 0; k < pending_count; ++k)
+    {
+        sparse_map_insert(&index_info->entity_to_slot_map, pending[k].entity, INDEX_SORTED);
+    }
+    index_info->pending.size = 0;
+
+    return ECS_OK;
+}
+
+static ecs_err_t index_slots(ecs_world_t *world, index_info_t *index_info, int first, int count)
+{
+    component_info_t *comp_info = &world->components[index_info->component];
+    for (int i = first; i < first + count; ++i)
+    {
+        void *comp;
+        ecs_entity_t entity;
+        vector_get(&comp_info->array, i, &comp);
+        vector_get_copy(&comp_info->entities, i, &entity);
+
+        uint64_t key = encode_key(index_info->key_type, index_info->size, (char *)comp + index_info->offset);
+        if (index_insert(index_info, entity, key) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t index_components(ecs_world_t *world, int component, int first, int count)
+{
+    if (world->components[component].index_count == 0)
+    {
+        return ECS_OK;
+    }
+
+    for (int i = 0; i < world->indices.size; ++i)
+    {
+        index_info_t *index_info;
+        vector_get(&world->indices, i, (void **)&index_info);
+        if (index_info->used && index_info->component == component && index_slots(world, index_info, first, count) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    return ECS_OK;
+}
+
+void unindex_component(ecs_world_t *world, int component, ecs_entity_t entity)
+{
+    for (int i = 0; i < world->indices.size; ++i)
+    {
+        index_info_t *index_info;
+        vector_get(&world->indices, i, (void **)&index_info);
+        if (index_info->used && index_info->component == component)
+        {
+            index_remove(index_info, entity);
+        }
+    }
+}
+
+static void clear_index(index_info_t *index_info)
+{
+    for (int i = 0; i < index_info->groups.size; ++i)
+    {
+        vector_free(&((index_group_t *)index_info->groups.data)[i].entities);
+    }
+    index_info->groups.size = 0;
+    free(index_info->buckets);
+    index_info->buckets = NULL;
+    index_info->bucket_capacity = 0;
+
+    index_info->sorted_keys.size = 0;
+    index_info->sorted_entities.size = 0;
+    index_info->pending.size = 0;
+    index_info->tombstones = 0;
+    sparse_map_clear(&index_info->entity_to_slot_map);
+}
+
+void free_index(ecs_world_t *world, index_info_t *index_info)
+{
+    if (!index_info->used)
+    {
+        return;
+    }
+
+    clear_index(index_info);
+    vector_free(&index_info->groups);
+    vector_free(&index_info->sorted_keys);
+    vector_free(&index_info->sorted_entities);
+    vector_free(&index_info->pending);
+    vector_free(&index_info->entity_keys);
+    sparse_map_destroy(&index_info->entity_to_slot_map);
+    index_info->used = false;
+
+    if (world->components != NULL)
+    {
+        --world->components[index_info->component].index_count;
+    }
+}
+
+static index_info_t *get_index_info(ecs_world_t *world, ecs_index_t index)
+{
+    if (index == 0 || index > world->indices.size)
+    {
+        return NULL;
+    }
+
+    index_info_t *index_info;
+    vector_get(&world->indices, index - 1, (void **)&index_info);
+
+    return index_info->used ? index_info : NULL;
+}
+
+ecs_err_t ecs_world_create_index_by_name(ecs_world_t *world, ecs_index_t *index, const char *name, size_t offset, size_t size, ecs_key_type_t key_type, ecs_index_kind_t kind)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if (!is_valid_key(key_type, size) || offset + size > comp_info->array.element_size ||
+            (kind != ECS_INDEX_HASH && kind != ECS_INDEX_ORDERED))
+    {
+        return ECS_ERR;
+    }
+
+    // Reuse a freed index slot
+    int index_ind = world->indices.size;
+    for (int i = 0; i < world->indices.size; ++i)
+    {
+        index_info_t *index_info;
+        vector_get(&world->indices, i, (void **)&index_info);
+        if (!index_info->used)
+        {
+            index_ind = i;
+            break;
+        }
+    }
+    if (index_ind == world->indices.size && vector_resize(&world->indices, index_ind + 1))
+    {
+        return ECS_ERR_MEM;
+    }
+
+    index_info_t *index_info;
+    vector_get(&world->indices, index_ind, (void **)&index_info);
+    *index_info = (index_info_t){ .used=true, .kind=kind, .key_type=key_type, .component=comp_info_ind, .offset=offset, .size=size };
+    vector_init(&index_info->entity_keys, sizeof(uint64_t), 0);
+    sparse_map_init(&index_info->entity_to_slot_map);
+    vector_init(&index_info->groups, sizeof(index_group_t), 0);
+    vector_init(&index_info->sorted_keys, sizeof(uint64_t), 0);
+    vector_init(&index_info->sorted_entities, sizeof(ecs_entity_t), 0);
+    vector_init(&index_info->pending, sizeof(index_entry_t), 0);
+    ++comp_info->index_count;
+
+    if (index_slots(world, index_info, 0, comp_info->array.size) != ECS_OK)
+    {
+        free_index(world, index_info);
+        return ECS_ERR_MEM;
+    }
+
+    *index = index_ind + 1;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_free_index(ecs_world_t *world, ecs_index_t index)
+{
+    index_info_t *index_info = get_index_info(world, index);
+    if (index_info == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    free_index(world, index_info);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_reindex_component_by_name(ecs_world_t *world, const char *name)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    for (int i = 0; i < world->indices.size; ++i)
+    {
+        index_info_t *index_info;
+        vector_get(&world->indices, i, (void **)&index_info);
+        if (index_info->used && index_info->component == comp_info_ind)
+        {
+            clear_index(index_info);
+        }
+    }
+
+    return index_components(world, comp_info_ind, 0, world->components[comp_info_ind].array.size);
+}
+
+ecs_err_t ecs_world_index_find(ecs_world_t *world, ecs_index_t index, const void *key, ecs_entity_t **entities, int *count)
+{
+    index_info_t *index_info = get_index_info(world, index);
+    if (index_info == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    if (index_info->kind == ECS_INDEX_ORDERED)
+    {
+        return ecs_world_index_range(world, index, key, key, entities, count);
+    }
+
+    index_group_t *group = get_index_group(index_info, encode_key(index_info->key_type, index_info->size, key), false);
+    *entities = group ? group->entities.data : NULL;
+    *count = group ? group->entities.size : 0;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_index_range(ecs_world_t *world, ecs_index_t index, const void *min, const void *max, ecs_entity_t **entities, int *count)
+{
+    index_info_t *index_info = get_index_info(world, index);
+    if (index_info == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+    if (index_info->kind != ECS_INDEX_ORDERED)
+    {
+        return ECS_ERR;
+    }
+    if (flush_ordered_index(index_info) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    uint64_t min_key = encode_key(index_info->key_type, index_info->size, min);
+    uint64_t max_key = encode_key(index_info->key_type, index_info->size, max);
+    uint64_t *keys = index_info->sorted_keys.data;
+    int size = index_info->sorted_keys.size;
+
+    // First key >= min and first key > max
+    int lo = 0, hi = size;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (keys[mid] < min_key) lo = mid + 1; else hi = mid;
+    }
+    int first = lo;
+    hi = size;
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (keys[mid] <= max_key) lo = mid + 1; else hi = mid;
+    }
+
+    *entities = (ecs_entity_t *)index_info->sorted_entities.data + first;
+    *count = lo - first;
+
+    return ECS_OK;
+}
+
+uint64_t ecs_encode_key(ecs_key_type_t type, size_t size, const void *value)
+{
+    return encode_key(type, size, value);
+}
+
+// Cells are clamped to +-SPATIAL_CELL_LIMIT so spans and loops over them
+// cannot overflow, NaN falls in cell 0
+static inline int spatial_cell(const spatial_index_t *spatial, float coordinate)
+{
+    float scaled = coordinate / spatial->cell_size;
+    if (!(scaled == scaled))
+    {
+        return 0;
+    }
+    if (scaled <= -(float)SPATIAL_CELL_LIMIT)
+    {
+        return -SPATIAL_CELL_LIMIT;
+    }
+    if (scaled >= (float)SPATIAL_CELL_LIMIT)
+    {
+        return SPATIAL_CELL_LIMIT;
+    }
+    int cell = (int)scaled;
+
+    return cell > scaled ? cell - 1 : cell;
+}
+
+static inline int spatial_hash(const spatial_index_t *spatial, const int *cell)
+{
+    uint32_t hash = (uint32_t)cell[0] * 73856093u ^ (uint32_t)cell[1] * 19349663u ^ (uint32_t)cell[2] * 83492791u;
+
+    return hash & spatial->cell_mask;
+}
+
+static inline int spatial_entry_hash(const spatial_index_t *spatial, const float *position)
+{
+    int cell[3] = { 0 };
+    for (int d = 0; d < spatial->dims; ++d)
+    {
+        cell[d] = spatial_cell(spatial, position[d]);
+    }
+
+    return spatial_hash(spatial, cell);
+}
+
+static inline void read_position(const spatial_index_t *spatial, const component_info_t *comp_info, int slot, float *position)
+{
+    position[2] = 0;
+    memcpy(position, (char *)comp_info->array.data + slot * comp_info->array.element_size + spatial->offset, spatial->dims * sizeof(float));
+}
+
+typedef struct
+{
+    spatial_index_t *spatial;
+    component_info_t *comp_info;
+    int threads;
+    int cells;
+    int *hashes;
+    int *counts;
+    int *range_bases;
+} spatial_build_t;
+
+// Parallel counting sort, every phase splits slots or cells evenly. Entries
+// keep the slot order within a cell whatever the number of threads.
+static void count_spatial_cells(spatial_build_t *build, int thread)
+{
+    int count = build->comp_info->array.size;
+    int *counts = build->counts + thread * build->cells;
+    for (int i = (int64_t)count * thread / build->threads; i < (int64_t)count * (thread + 1) / build->threads; ++i)
+    {
+        float position[3];
+        read_position(build->spatial, build->comp_info, i, position);
+        build->hashes[i] = spatial_entry_hash(build->spatial, position);
+        ++counts[build->hashes[i]];
+    }
+}
+
+static void sum_spatial_cells(spatial_build_t *build, int thread)
+{
+    int sum = 0;
+    for (int h = (int64_t)build->cells * thread / build->threads; h < (int64_t)build->cells * (thread + 1) / build->threads; ++h)
+    {
+        for (int t = 0; t < build->threads; ++t)
+        {
+            sum += build->counts[t * build->cells + h];
+        }
+    }
+    build->range_bases[thread] = sum;
+}
+
+static void offset_spatial_cells(spatial_build_t *build, int thread)
+{
+    int *cell_starts = build->spatial->cell_starts.data;
+    int offset = build->range_bases[thread];
+    for (int h = (int64_t)build->cells * thread / build->threads; h < (int64_t)build->cells * (thread + 1) / build->threads; ++h)
+    {
+        cell_starts[h] = offset;
+        for (int t = 0; t < build->threads; ++t)
+        {
+            int count = build->counts[t * build->cells + h];
+            build->counts[t * build->cells + h] = offset;
+            offset += count;
+        }
+    }
+}
+
+static void scatter_spatial_entries(spatial_build_t *build, int thread)
+{
+    component_info_t *comp_info = build->comp_info;
+    spatial_entry_t *entries = build->spatial->entries.data;
+    int *entity_to_entry = build->spatial->entity_to_entry_map.values.data;
+    int *counts = build->counts + thread * build->cells;
+    int count = comp_info->array.size;
+    for (int i = (int64_t)count * thread / build->threads; i < (int64_t)count * (thread + 1) / build->threads; ++i)
+    {
+        int entry = counts[build->hashes[i]]++;
+        entries[entry].entity = ((ecs_entity_t *)comp_info->entities.data)[i];
+        read_position(build->spatial, comp_info, i, entries[entry].position);
+        entity_to_entry[entries[entry].entity] = entry;
+    }
+}
+
+typedef struct
+{
+    spatial_build_t *build;
+    void (*phase)(spatial_build_t *, int);
+} spatial_task_t;
+
+static void run_spatial_task(void *arg, int thread, bool threaded)
+{
+    spatial_task_t *task = arg;
+    (void)threaded;
+    task->phase(task->build, thread);
+}
+
+// Phases run on the worker pool of the world, the caller taking the first
+// slice
+static void run_spatial_phase(worker_pool_t *pool, spatial_build_t *build, void (*phase)(spatial_build_t *, int))
+{
+    if (build->threads == 1)
+    {
+        phase(build, 0);
+        return;
+    }
+
+    spatial_task_t task = { build, phase };
+    worker_pool_run(pool, 1, build->threads, run_spatial_task, &task);
+}
+
+static ecs_err_t rebuild_spatial_index(ecs_world_t *world, spatial_index_t *spatial)
+{
+    component_info_t *comp_info = &world->components[spatial->component];
+    int count = comp_info->array.size;
+
+    // About two entries per cell
+    int cells = 1;
+    while (cells * 2 < count)
+    {
+        cells *= 2;
+    }
+    // Bounded by the CPUs, and run on the calling thread from a worker of
+    // the world, whose pool is busy
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = spatial->threads < count / 1024 ? spatial->threads : count / 1024;
+    threads = cpus > 0 && threads > cpus ? (int)cpus : threads;
+    worker_pool_t *pool = threads > 1 && !(worker_scratch && cs == world) ? get_worker_pool(world) : NULL;
+    threads = pool && threads > 0 ? threads : 1;
+
+    spatial_build_t build = { .spatial=spatial, .comp_info=comp_info, .threads=threads, .cells=cells };
+    build.hashes = malloc(count * sizeof(int) + 1);
+    build.counts = calloc(threads * cells, sizeof(int));
+    build.range_bases = malloc(threads * sizeof(int));
+    spatial->cell_mask = cells - 1;
+    if (build.hashes == NULL || build.counts == NULL || build.range_bases == NULL ||
+            vector_resize(&spatial->cell_starts, cells + 1) || vector_resize(&spatial->entries, count) ||
+            sparse_map_reserve(&spatial->entity_to_entry_map, world->next_entities))
+    {
+        free(build.hashes);
+        free(build.counts);
+        free(build.range_bases);
+        return ECS_ERR_MEM;
+    }
+    sparse_map_clear(&spatial->entity_to_entry_map);
+
+    run_spatial_phase(pool, &build, count_spatial_cells);
+    run_spatial_phase(pool, &build, sum_spatial_cells);
+    for (int t = 0, base = 0; t < threads; ++t)
+    {
+        int sum = build.range_bases[t];
+        build.range_bases[t] = base;
+        base += sum;
+    }
+    run_spatial_phase(pool, &build, offset_spatial_cells);
+    ((int *)spatial->cell_starts.data)[cells] = count;
+    run_spatial_phase(pool, &build, scatter_spatial_entries);
+
+    free(build.hashes);
+    free(build.counts);
+    free(build.range_bases);
+
+    spatial->tombstones = 0;
+    spatial->moved.size = 0;
+    spatial->stale = false;
+
+    return ECS_OK;
+}
+
+static ecs_err_t move_spatial_entry(spatial_index_t *spatial, ecs_entity_t entity, const float *position)
+{
+    int entry;
+    spatial_entry_t *entries = spatial->entries.data;
+    if (sparse_map_get(&spatial->entity_to_entry_map, entity, &entry))
+    {
+        spatial_entry_t *moved = spatial->moved.data;
+        if (entry & SPATIAL_MOVED)
+        {
+            memcpy(moved[entry & ~SPATIAL_MOVED].position, position, sizeof(float) * 3);
+            return ECS_OK;
+        }
+        if (memcmp(entries[entry].position, position, sizeof(float) * 3) == 0)
+        {
+            return ECS_OK;
+        }
+
+        // Entries staying in their cell are updated in place
+        if (spatial_entry_hash(spatial, entries[entry].position) == spatial_entry_hash(spatial, position))
+        {
+            int same = 1;
+            for (int d = 0; d < spatial->dims; ++d)
+            {
+                same &= spatial_cell(spatial, entries[entry].position[d]) == spatial_cell(spatial, position[d]);
+            }
+            if (same)
+            {
+                memcpy(entries[entry].position, position, sizeof(float) * 3);
+                return ECS_OK;
+            }
+        }
+        entries[entry].entity = 0;
+        ++spatial->tombstones;
+    }
+
+    spatial_entry_t moved_entry = { .entity=entity };
+    memcpy(moved_entry.position, position, sizeof(float) * 3);
+    if (vector_push_back(&spatial->moved, &moved_entry) ||
+            sparse_map_insert(&spatial->entity_to_entry_map, entity, (spatial->moved.size - 1) | SPATIAL_MOVED))
+    {
+        return ECS_ERR_MEM;
+    }
+
+    return ECS_OK;
+}
+
+// Applies the chunks written since the last update to every spatial index
+// of the component, rebuilding the ones with too many moved entries
+static ecs_err_t update_spatial_indices(ecs_world_t *world, int component)
+{
+    component_info_t *comp_info = &world->components[component];
+    uint64_t *moved_chunks = comp_info->moved_chunks.data;
+    ecs_err_t ret = ECS_OK;
+    for (int word = 0; word < comp_info->moved_chunks.size; ++word)
+    {
+        while (moved_chunks[word])
+        {
+            int chunk = word * 64 + __builtin_ctzll(moved_chunks[word]);
+            moved_chunks[word] &= moved_chunks[word] - 1;
+
+            int end = (chunk + 1) * CHUNK_SIZE < comp_info->array.size ? (chunk + 1) * CHUNK_SIZE : comp_info->array.size;
+            for (int j = 0; j < world->spatial_indices.size; ++j)
+            {
+                spatial_index_t *spatial;
+                vector_get(&world->spatial_indices, j, (void **)&spatial);
+                if (!spatial->used || spatial->component != component || spatial->stale)
+                {
+                    continue;
+                }
+
+                for (int i = chunk * CHUNK_SIZE; i < end; ++i)
+                {
+                    float position[3];
+                    read_position(spatial, comp_info, i, position);
+                    if (move_spatial_entry(spatial, ((ecs_entity_t *)comp_info->entities.data)[i], position) != ECS_OK)
+                    {
+                        spatial->stale = true;
+                    }
+                }
+            }
+        }
+    }
+
+    for (int j = 0; j < world->spatial_indices.size; ++j)
+    {
+        spatial_index_t *spatial;
+        vector_get(&world->spatial_indices, j, (void **)&spatial);
+        if (spatial->used && spatial->component == component &&
+                (spatial->stale || spatial->moved.size + spatial->tombstones > spatial->entries.size / 4 + CHUNK_SIZE))
+        {
+            ret |= rebuild_spatial_index(world, spatial);
+        }
+    }
+
+    return ret;
+}
+
+void unindex_spatial(ecs_world_t *world, int component, ecs_entity_t entity)
+{
+    for (int j = 0; j < world->spatial_indices.size; ++j)
+    {
+        spatial_index_t *spatial;
+        vector_get(&world->spatial_indices, j, (void **)&spatial);
+        int entry;
+        if (!spatial->used || spatial->component != component || !sparse_map_get(&spatial->entity_to_entry_map, entity, &entry))
+        {
+            continue;
+        }
+
+        sparse_map_remove(&spatial->entity_to_entry_map, entity);
+        if (entry & SPATIAL_MOVED)
+        {
+            // The last moved entry takes the place of the removed one
+            spatial_entry_t *moved = spatial->moved.data;
+            int last = spatial->moved.size - 1;
+            entry &= ~SPATIAL_MOVED;
+            if (entry != last)
+            {
+                moved[entry] = moved[last];
+                sparse_map_insert(&spatial->entity_to_entry_map, moved[entry].entity, entry | SPATIAL_MOVED);
+            }
+            --spatial->moved.size;
+        }
+        else
+        {
+            ((spatial_entry_t *)spatial->entries.data)[entry].entity = 0;
+            ++spatial->tombstones;
+        }
+    }
+}
+
+void invalidate_spatial_indices(ecs_world_t *world)
+{
+    for (int j = 0; j < world->spatial_indices.size; ++j)
+    {
+        spatial_index_t *spatial;
+        vector_get(&world->spatial_indices, j, (void **)&spatial);
+        spatial->stale = true;
+    }
+}
+
+void free_spatial_index(ecs_world_t *world, spatial_index_t *spatial)
+{
+    if (!spatial->used)
+    {
+        return;
+    }
+
+    vector_free(&spatial->cell_starts);
+    vector_free(&spatial->entries);
+    vector_free(&spatial->moved);
+    vector_free(&spatial->results);
+    sparse_map_destroy(&spatial->entity_to_entry_map);
+    spatial->used = false;
+
+    if (world->components != NULL)
+    {
+        --world->components[spatial->component].spatial_count;
+    }
+}
+
+static spatial_index_t *get_spatial_index(ecs_world_t *world, ecs_spatial_index_t index)
+{
+    if (index == 0 || index > world->spatial_indices.size)
+    {
+        return NULL;
+    }
+
+    spatial_index_t *spatial;
+    vector_get(&world->spatial_indices, index - 1, (void **)&spatial);
+
+    return spatial->used ? spatial : NULL;
+}
+
+ecs_err_t ecs_world_create_spatial_index_by_name(ecs_world_t *world, ecs_spatial_index_t *index, const char *name, size_t offset, int dims, float cell_size)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    if ((dims != 2 && dims != 3) || !(cell_size > 0) || offset + dims * sizeof(float) > comp_info->array.element_size)
+    {
+        return ECS_ERR;
+    }
+
+    // Reuse a freed index slot
+    int index_ind = world->spatial_indices.size;
+    for (int i = 0; i < world->spatial_indices.size; ++i)
+    {
+        spatial_index_t *spatial;
+        vector_get(&world->spatial_indices, i, (void **)&spatial);
+        if (!spatial->used)
+        {
+            index_ind = i;
+            break;
+        }
+    }
+    if (index_ind == world->spatial_indices.size && vector_resize(&world->spatial_indices, index_ind + 1))
+    {
+        return ECS_ERR_MEM;
+    }
+
+    spatial_index_t *spatial;
+    vector_get(&world->spatial_indices, index_ind, (void **)&spatial);
+    *spatial = (spatial_index_t){ .used=true, .component=comp_info_ind, .offset=offset, .dims=dims, .cell_size=cell_size, .threads=1 };
+    vector_init(&spatial->cell_starts, sizeof(int), 0);
+    vector_init(&spatial->entries, sizeof(spatial_entry_t), 0);
+    vector_init(&spatial->moved, sizeof(spatial_entry_t), 0);
+    vector_init(&spatial->results, sizeof(ecs_entity_t), 0);
+    sparse_map_init(&spatial->entity_to_entry_map);
+
+    // Pending moves of the other indices are applied before tracking starts
+    if (update_spatial_indices(world, comp_info_ind) != ECS_OK || rebuild_spatial_index(world, spatial) != ECS_OK)
+    {
+        free_spatial_index(world, spatial);
+        return ECS_ERR_MEM;
+    }
+    ++comp_info->spatial_count;
+
+    *index = index_ind + 1;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_free_spatial_index(ecs_world_t *world, ecs_spatial_index_t index)
+{
+    spatial_index_t *spatial = get_spatial_index(world, index);
+    if (spatial == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    free_spatial_index(world, spatial);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_rebuild_spatial_index(ecs_world_t *world, ecs_spatial_index_t index, int threads)
+{
+    spatial_index_t *spatial = get_spatial_index(world, index);
+    if (spatial == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    spatial->threads = threads > 0 ? threads : 1;
+    if (update_spatial_indices(world, spatial->component) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    return rebuild_spatial_index(world, spatial);
+}
+
+static bool spatial_entry_matches(const spatial_index_t *spatial, const float *position, const float *min, const float *max, const float *center, float radius)
+{
+    float distance = 0;
+    for (int d = 0; d < spatial->dims; ++d)
+    {
+        // NaN is never inside
+        if (!(position[d] >= min[d] && position[d] <= max[d]))
+        {
+            return false;
+        }
+        if (center != NULL)
+        {
+            distance += (position[d] - center[d]) * (position[d] - center[d]);
+        }
+    }
+
+    return center == NULL || distance <= radius * radius;
+}
+
+// Collects the entries within [min, max], and within `radius` of `center`
+// when not NULL
+static ecs_err_t spatial_query(ecs_world_t *world, ecs_spatial_index_t index, const float *min, const float *max, const float *center, float radius, ecs_entity_t **entities, int *count)
+{
+    spatial_index_t *spatial = get_spatial_index(world, index);
+    if (spatial == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+    if (update_spatial_indices(world, spatial->component) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    spatial->results.size = 0;
+    int ret = 0;
+    int lo[3] = { 0 }, hi[3] = { 0 };
+    int64_t cell_count = 1;
+    for (int d = 0; d < spatial->dims; ++d)
+    {
+        lo[d] = spatial_cell(spatial, min[d]);
+        hi[d] = spatial_cell(spatial, max[d]);
+
+        // Saturated, huge boxes scan every entry anyway
+        int64_t span = (int64_t)hi[d] - lo[d] + 1;
+        cell_count *= span < INT_MAX ? span : INT_MAX;
+        cell_count = cell_count < INT_MAX ? cell_count : INT_MAX;
+    }
+
+    spatial_entry_t *entries = spatial->entries.data;
+    int *cell_starts = spatial->cell_starts.data;
+    if (min[0] > max[0] || min[1] > max[1] || (spatial->dims == 3 && min[2] > max[2]))
+    {
+        cell_count = 0;
+    }
+    else if (cell_count > spatial->cell_mask + 1)
+    {
+        // Boxes spanning more cells than hashes scan every entry
+        for (int i = 0; i < spatial->entries.size; ++i)
+        {
+            if (entries[i].entity && spatial_entry_matches(spatial, entries[i].position, min, max, center, radius))
+            {
+                ret |= vector_push_back(&spatial->results, &entries[i].entity);
+            }
+        }
+    }
+    else
+    {
+        // Entries of colliding cells are told apart by their own cell
+        int cell[3];
+        for (cell[2] = lo[2]; cell[2] <= hi[2]; ++cell[2])
+        {
+            for (cell[1] = lo[1]; cell[1] <= hi[1]; ++cell[1])
+            {
+                for (cell[0] = lo[0]; cell[0] <= hi[0]; ++cell[0])
+                {
+                    int hash = spatial_hash(spatial, cell);
+                    for (int i = cell_starts[hash]; i < cell_starts[hash + 1]; ++i)
+                    {
+                        bool same = entries[i].entity != 0;
+                        for (int d = 0; d < spatial->dims && same; ++d)
+                        {
+                            same = spatial_cell(spatial, entries[i].position[d]) == cell[d];
+                        }
+                        if (same && spatial_entry_matches(spatial, entries[i].position, min, max, center, radius))
+                        {
+                            ret |= vector_push_back(&spatial->results, &entries[i].entity);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    spatial_entry_t *moved = spatial->moved.data;
+    for (int i = 0; cell_count > 0 && i < spatial->moved.size; ++i)
+    {
+        if (spatial_entry_matches(spatial, moved[i].position, min, max, center, radius))
+        {
+            ret |= vector_push_back(&spatial->results, &moved[i].entity);
+        }
+    }
+
+    *entities = spatial->results.data;
+    *count = spatial->results.size;
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+ecs_err_t ecs_world_spatial_query_radius(ecs_world_t *world, ecs_spatial_index_t index, const float *center, float radius, ecs_entity_t **entities, int *count)
+{
+    spatial_index_t *spatial = get_spatial_index(world, index);
+    if (spatial == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    float min[3] = { 0 }, max[3] = { 0 };
+    for (int d = 0; d < spatial->dims; ++d)
+    {
+        min[d] = center[d] - radius;
+        max[d] = center[d] + radius;
+    }
+
+    return spatial_query(world, index, min, max, center, radius, entities, count);
+}
+
+ecs_err_t ecs_world_spatial_query_aabb(ecs_world_t *world, ecs_spatial_index_t index, const float *min, const float *max, ecs_entity_t **entities, int *count)
+{
+    return spatial_query(world, index, min, max, NULL, 0, entities, count);
+}
+
+static ecs_err_t permute_column(vector_t *column, const uint32_t *order, void (*move)(void *, void *, int))
+{
+    size_t element_size = column->element_size;
+    char *data = column->data;
+    char *ndata = malloc(column->capacity * element_size);
+    if (ndata == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    for (int i = 0; i < column->size; ++i)
+    {
+        if (move)
+        {
+            move(ndata + i * element_size, data + order[i] * element_size, 1);
+        }
+        else
+        {
+            memcpy(ndata + i * element_size, data + order[i] * element_size, element_size);
+        }
+    }
+    free(column->data);
+    column->data = ndata;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_sort_component_by_name(ecs_world_t *world, const char *name, ecs_sort_key_t key_fn, bool incremental)
+{
+    int comp_info_ind;
+    if (!stoi_map_get(&world->component_name_to_index_map, name, &comp_info_ind) || key_fn == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    int count = comp_info->array.size;
+    if (count < 2)
+    {
+        return ECS_OK;
+    }
+
+    uint64_t *keys = malloc(count * 2 * (sizeof(uint64_t) + sizeof(uint32_t)));
+    if (keys == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+    uint64_t *tmp_keys = keys + count;
+    uint32_t *order = (uint32_t *)(tmp_keys + count);
+    uint32_t *tmp_order = order + count;
+
+    for (int i = 0; i < count; ++i)
+    {
+        void *comp;
+        vector_get(&comp_info->array, i, &comp);
+        keys[i] = key_fn(comp);
+        order[i] = i;
+    }
+
+    // Pools sorted on the previous frame usually need a few moves, the
+    // radix sort takes over when they need too many
+    if (!incremental || insertion_sort_u64(keys, order, count, 4l * count))
+    {
+        radix_sort_u64(keys, order, count, tmp_keys, tmp_order);
+    }
+
+    ecs_err_t ret = reorder_pool(world, comp_info_ind, order, tmp_order);
+    comp_info->key_sorted = ret == ECS_OK;
+    free(keys);
+
+    return ret;
+}
+
+// Moves the slot order[i] of a pool to slot i, `tmp` holding as many ids
+ecs_err_t reorder_pool(ecs_world_t *world, int comp_info_ind, const uint32_t *order, ecs_entity_t *tmp)
+{
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    int count = comp_info->array.size;
+    bool identity = true;
+    for (int i = 0; i < count && identity; ++i)
+    {
+        identity = order[i] == (uint32_t)i;
+    }
+    if (identity)
+    {
+        return ECS_OK;
+    }
+
+    journal_write(&comp_info->array_journal, &comp_info->array, 0, count);
+    journal_write(&comp_info->entities_journal, &comp_info->entities, 0, count);
+    mark_chunks_stale(comp_info, 0, count);
+    if (permute_column(&comp_info->array, order, comp_info->hooks.move) != ECS_OK ||
+            permute_column(&comp_info->entities, order, NULL) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+    if (comp_info->double_buffered)
+    {
+        begin_previous_write(comp_info);
+        ecs_err_t ret = permute_column(&comp_info->previous, order, NULL);
+        end_previous_write(comp_info);
+        if (ret != ECS_OK)
+        {
+            return ret;
+        }
+    }
+
+    ecs_entity_t *entities = comp_info->entities.data;
+    for (int i = 0; i < count; ++i)
+    {
+        sparse_map_insert(&comp_info->entity_to_index_map, entities[i], i);
+    }
+
+    if (comp_info->double_buffered)
+    {
+        // Written slots moved, every chunk is carried over at the next flip
+        bool dirty = false;
+        for (int i = 0; i < comp_info->dirty_chunks.size && !dirty; ++i)
+        {
+            dirty = ((uint64_t *)comp_info->dirty_chunks.data)[i] != 0;
+        }
+        for (int i = 0; dirty && i < count; i += CHUNK_SIZE)
+        {
+            mark_chunk_dirty(comp_info, i);
+        }
+    }
+
+    // Queries requiring the component follow the pool order, so iterating
+    // them walks the pool linearly
+    ecs_entity_t *query_entities = tmp;
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        if (!query_info->used || !(query_info->with & (1 << comp_info_ind)))
+        {
+            continue;
+        }
+
+        journal_write(&query_info->entities_journal, &query_info->entities, 0, query_info->entities.size);
+        int size = 0;
+        for (int j = 0; j < count; ++j)
+        {
+            if (sparse_map_get(&query_info->entity_to_index_map, entities[j], NULL))
+            {
+                sparse_map_insert(&query_info->entity_to_index_map, entities[j], size);
+                query_entities[size++] = entities[j];
+            }
+        }
+        memcpy(query_info->entities.data, query_entities, size * sizeof(ecs_entity_t));
+        query_info->enabled_stale = true;
+    }
+
+    return ECS_OK;
+}
+
+static void journal_start(journal_t *journal, vector_t *column)
+{
+    journal_stop(journal);
+    journal->active = true;
+    journal->fork_size = column->size;
+    vector_init(&journal->saved_pages, sizeof(uint64_t), 0);
+    vector_init(&journal->page_indices, sizeof(int), 0);
+    vector_init(&journal->pages, CHUNK_SIZE * column->element_size, 0);
+}
+
+void journal_stop(journal_t *journal)
+{
+    vector_free(&journal->saved_pages);
+    vector_free(&journal->page_indices);
+    vector_free(&journal->pages);
+    *journal = (journal_t){ 0 };
+}
+
+void journal_write(journal_t *journal, vector_t *column, int first, int count)
+{
+    // Slots appended after the fork are dropped by the restore
+    int end = first + count < journal->fork_size ? first + count : journal->fork_size;
+    if (!journal->active || first >= end)
+    {
+        return;
+    }
+
+    size_t element_size = column->element_size;
+    for (int page = first / CHUNK_SIZE; page <= (end - 1) / CHUNK_SIZE; ++page)
+    {
+        int word = page / 64;
+        if (word < journal->saved_pages.size && (((uint64_t *)journal->saved_pages.data)[word] & (1ull << (page % 64))))
+        {
+            continue;
+        }
+
+        int old_words = journal->saved_pages.size;
+        if ((word >= old_words && vector_resize(&journal->saved_pages, word + 1)) ||
+                vector_push_back(&journal->page_indices, &page) || vector_resize(&journal->pages, journal->pages.size + 1))
+        {
+            journal->failed = true;
+            return;
+        }
+        if (word >= old_words)
+        {
+            memset((uint64_t *)journal->saved_pages.data + old_words, 0, (word + 1 - old_words) * sizeof(uint64_t));
+        }
+        ((uint64_t *)journal->saved_pages.data)[word] |= 1ull << (page % 64);
+
+        int slots = journal->fork_size - page * CHUNK_SIZE < CHUNK_SIZE ? journal->fork_size - page * CHUNK_SIZE : CHUNK_SIZE;
+        void *saved;
+        vector_get(&journal->pages, journal->pages.size - 1, &saved);
+        memcpy(saved, (char *)column->data + page * CHUNK_SIZE * element_size, slots * element_size);
+    }
+}
+
+static inline ecs_entity_t column_entity(vector_t *column, int index, size_t entity_offset)
+{
+    return *(ecs_entity_t *)((char *)column->data + index * column->element_size + entity_offset);
+}
+
+// Copies the saved pages back and truncates the column to its fork size.
+// `map` maps the entity at `entity_offset` in each slot to its slot.
+static bool journal_restore(journal_t *journal, vector_t *column, sparse_map_t *map, size_t entity_offset)
+{
+    int *page_indices = journal->page_indices.data;
+    int page_count = journal->page_indices.size;
+    int fork_size = journal->fork_size;
+    bool changed = page_count > 0 || column->size != fork_size;
+
+    // Unmap the entities of the slots about to change
+    if (map)
+    {
+        for (int p = 0; p < page_count; ++p)
+        {
+            int end = (page_indices[p] + 1) * CHUNK_SIZE < column->size ? (page_indices[p] + 1) * CHUNK_SIZE : column->size;
+            for (int i = page_indices[p] * CHUNK_SIZE; i < end; ++i)
+            {
+                sparse_map_remove(map, column_entity(column, i, entity_offset));
+            }
+        }
+        for (int i = fork_size; i < column->size; ++i)
+        {
+            sparse_map_remove(map, column_entity(column, i, entity_offset));
+        }
+    }
+
+    size_t element_size = column->element_size;
+    for (int p = 0; p < page_count; ++p)
+    {
+        int first = page_indices[p] * CHUNK_SIZE;
+        int slots = fork_size - first < CHUNK_SIZE ? fork_size - first : CHUNK_SIZE;
+        void *saved;
+        vector_get(&journal->pages, p, &saved);
+        memcpy((char *)column->data + first * element_size, saved, slots * element_size);
+    }
+    column->size = fork_size;
+
+    if (map)
+    {
+        for (int p = 0; p < page_count; ++p)
+        {
+            int end = (page_indices[p] + 1) * CHUNK_SIZE < fork_size ? (page_indices[p] + 1) * CHUNK_SIZE : fork_size;
+            for (int i = page_indices[p] * CHUNK_SIZE; i < end; ++i)
+            {
+                sparse_map_insert(map, column_entity(column, i, entity_offset), i);
+            }
+        }
+    }
+
+    // The fork point stays armed
+    journal->page_indices.size = 0;
+    journal->pages.size = 0;
+    if (journal->saved_pages.size > 0)
+    {
+        memset(journal->saved_pages.data, 0, journal->saved_pages.size * sizeof(uint64_t));
+    }
+
+    return changed;
+}
+
+ecs_err_t ecs_world_fork(ecs_world_t *world)
+{
+    if (flush_reserved_entities(world) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // Raw pages cannot be restored under hooks or pooled buffers, and flips
+    // swap the buffers
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        component_info_t *comp_info = &world->components[i];
+        ecs_component_hooks_t *hooks = &comp_info->hooks;
+        if (comp_info->double_buffered || comp_info->buffer || hooks->ctor || hooks->dtor || hooks->move || hooks->copy)
+        {
+            return ECS_ERR;
+        }
+    }
+
+    // Forking again moves the fork point
+    ecs_world_commit_fork(world);
+
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        component_info_t *comp_info = &world->components[i];
+        if (comp_info->array.element_size == 0)
+        {
+            continue;
+        }
+
+        journal_start(&comp_info->array_journal, &comp_info->array);
+        journal_start(&comp_info->entities_journal, &comp_info->entities);
+        if (comp_info->resource)
+        {
+            comp_info->fork_resource = malloc(comp_info->array.element_size);
+            if (comp_info->fork_resource == NULL)
+            {
+                ecs_world_commit_fork(world);
+                return ECS_ERR_MEM;
+            }
+            memcpy(comp_info->fork_resource, comp_info->resource, comp_info->array.element_size);
+        }
+    }
+
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        if (query_info->used)
+        {
+            journal_start(&query_info->entities_journal, &query_info->entities);
+        }
+    }
+
+    journal_start(&world->entities_journal, &world->entities);
+    journal_start(&world->recycled_journal, &world->recycled_entities);
+    world->fork_next_entities = world->next_entities;
+    world->forked = true;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_restore_fork(ecs_world_t *world)
+{
+    if (!world->forked)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    // Pending reservations are dropped with the ids they took
+    bool failed = world->entities_journal.failed || world->recycled_journal.failed;
+    journal_restore(&world->entities_journal, &world->entities, &world->entity_to_index_map, offsetof(entity_info_t, entity));
+    journal_restore(&world->recycled_journal, &world->recycled_entities, NULL, 0);
+    world->next_entities = world->fork_next_entities;
+    world->flushed_next_entities = world->fork_next_entities;
+    world->recycled_available = world->recycled_entities.size;
+    failed |= rebuild_inactive_entities(world) != ECS_OK;
+
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        component_info_t *comp_info = &world->components[i];
+        if (comp_info->array.element_size == 0)
+        {
+            continue;
+        }
+
+        // Restored pages and dropped slots are hashed again
+        for (int j = 0; j < 2; ++j)
+        {
+            journal_t *journal = j ? &comp_info->entities_journal : &comp_info->array_journal;
+            for (int p = 0; p < journal->page_indices.size; ++p)
+            {
+                mark_chunks_stale(comp_info, ((int *)journal->page_indices.data)[p] * CHUNK_SIZE, 1);
+            }
+        }
+        mark_chunks_stale(comp_info, comp_info->array_journal.fork_size, comp_info->array.size - comp_info->array_journal.fork_size);
+
+        // Components registered during the fork had no instance at the fork
+        if (!comp_info->array_journal.active)
+        {
+            comp_info->array.size = 0;
+            comp_info->entities.size = 0;
+            sparse_map_clear(&comp_info->entity_to_index_map);
+            journal_start(&comp_info->array_journal, &comp_info->array);
+            journal_start(&comp_info->entities_journal, &comp_info->entities);
+        }
+
+        failed |= comp_info->array_journal.failed || comp_info->entities_journal.failed;
+        bool changed = journal_restore(&comp_info->array_journal, &comp_info->array, NULL, 0);
+        changed |= journal_restore(&comp_info->entities_journal, &comp_info->entities, &comp_info->entity_to_index_map, 0);
+
+        if (comp_info->fork_resource)
+        {
+            if (comp_info->resource == NULL && (comp_info->resource = malloc(comp_info->array.element_size)) == NULL)
+            {
+                failed = true;
+            }
+            else
+            {
+                memcpy(comp_info->resource, comp_info->fork_resource, comp_info->array.element_size);
+            }
+        }
+        else
+        {
+            free(comp_info->resource);
+            comp_info->resource = NULL;
+        }
+
+        // Value indices are rebuilt over the restored pools
+        if (changed && comp_info->index_count > 0)
+        {
+            for (int j = 0; j < world->indices.size; ++j)
+            {
+                index_info_t *index_info;
+                vector_get(&world->indices, j, (void **)&index_info);
+                if (index_info->used && index_info->component == i)
+                {
+                    clear_index(index_info);
+                }
+            }
+            failed |= index_components(world, i, 0, comp_info->array.size) != ECS_OK;
+        }
+    }
+
+    invalidate_spatial_indices(world);
+
+    // The hierarchy was copied at its first change
+    hierarchy_t *fork_hierarchy = world->fork_hierarchy;
+    if (fork_hierarchy)
+    {
+        hierarchy_t *hierarchy = &world->hierarchy;
+        if (vector_resize(&hierarchy->entities, fork_hierarchy->entities.size) ||
+                vector_resize(&hierarchy->sizes, fork_hierarchy->sizes.size))
+        {
+            failed = true;
+        }
+        else
+        {
+            memcpy(hierarchy->entities.data, fork_hierarchy->entities.data, fork_hierarchy->entities.size * sizeof(ecs_entity_t));
+            memcpy(hierarchy->sizes.data, fork_hierarchy->sizes.data, fork_hierarchy->sizes.size * sizeof(int));
+            failed |= rebuild_hierarchy_maps(hierarchy) != ECS_OK;
+        }
+    }
+
+    // Queries created during the fork are matched again
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        if (!query_info->used)
+        {
+            continue;
+        }
+
+        if (query_info->entities_journal.active)
+        {
+            failed |= query_info->entities_journal.failed;
+            journal_restore(&query_info->entities_journal, &query_info->entities, &query_info->entity_to_index_map, 0);
+            query_info->enabled_stale = true;
+        }
+        else
+        {
+            query_info->entities.size = 0;
+            sparse_map_clear(&query_info->entity_to_index_map);
+            populate_query(world, query_info);
+            journal_start(&query_info->entities_journal, &query_info->entities);
+        }
+    }
+
+    return failed ? ECS_ERR_MEM : ECS_OK;
+}
+
+ecs_err_t ecs_world_commit_fork(ecs_world_t *world)
+{
+    if (!world->forked)
+    {
+        return ECS_OK;
+    }
+
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        journal_stop(&world->components[i].array_journal);
+        journal_stop(&world->components[i].entities_journal);
+        free(world->components[i].fork_resource);
+        world->components[i].fork_resource = NULL;
+    }
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        journal_stop(&query_info->entities_journal);
+    }
+    journal_stop(&world->entities_journal);
+    journal_stop(&world->recycled_journal);
+    if (world->fork_hierarchy)
+    {
+        free_hierarchy(world->fork_hierarchy);
+        free(world->fork_hierarchy);
+        world->fork_hierarchy = NULL;
+    }
+    world->forked = false;
+
+    return ECS_OK;
+}
+
+static void init_snapshot_state(snapshot_state_t *state)
+{
+    for (int i = 0; i < SNAPSHOT_BLOB_COUNT; ++i)
+    {
+        vector_init(&state->blobs[i], 1, 0);
+    }
+}
+
+static void free_snapshot_state(snapshot_state_t *state)
+{
+    for (int i = 0; i < SNAPSHOT_BLOB_COUNT; ++i)
+    {
+        vector_free(&state->blobs[i]);
+    }
+}
+
+static int set_blob(vector_t *blob, const void *data, size_t size)
+{
+    if (vector_resize(blob, size))
+    {
+        return 1;
+    }
+    if (size > 0)
+    {
+        memcpy(blob->data, data, size * blob->element_size);
+    }
+
+    return 0;
+}
+
+static ecs_err_t copy_snapshot_state(snapshot_state_t *dst, snapshot_state_t *src)
+{
+    for (int i = 0; i < SNAPSHOT_BLOB_COUNT; ++i)
+    {
+        if (set_blob(&dst->blobs[i], src->blobs[i].data, src->blobs[i].size))
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    return ECS_OK;
+}
+
+static ecs_err_t apply_snapshot_delta(snapshot_state_t *state, vector_t *delta)
+{
+    const uint8_t *in = delta->data;
+    for (int i = 0; i < SNAPSHOT_BLOB_COUNT; ++i)
+    {
+        if (xor_delta_apply(&state->blobs[i], &in))
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    return ECS_OK;
+}
+
+static ecs_err_t capture_snapshot_state(ecs_world_t *world, snapshot_state_t *state)
+{
+    snapshot_header_t header = { .next_entities=world->next_entities };
+    int ret = 0;
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        component_info_t *comp_info = &world->components[i];
+        size_t element_size = comp_info->array.element_size;
+        header.element_sizes[i] = element_size;
+
+        vector_t *blobs = &state->blobs[3 + 3 * i];
+        ret |= set_blob(&blobs[0], comp_info->array.data, comp_info->array.size * element_size);
+        ret |= set_blob(&blobs[1], comp_info->entities.data, comp_info->entities.size * sizeof(ecs_entity_t));
+        ret |= set_blob(&blobs[2], comp_info->resource, comp_info->resource ? element_size : 0);
+    }
+    ret |= set_blob(&state->blobs[0], &header, sizeof(header));
+    ret |= set_blob(&state->blobs[1], world->entities.data, world->entities.size * sizeof(entity_info_t));
+    ret |= set_blob(&state->blobs[2], world->recycled_entities.data, world->recycled_entities.size * sizeof(ecs_entity_t));
+    ret |= set_blob(&state->blobs[SNAPSHOT_HIERARCHY_BLOB], world->hierarchy.entities.data, world->hierarchy.entities.size * sizeof(ecs_entity_t));
+    ret |= set_blob(&state->blobs[SNAPSHOT_HIERARCHY_BLOB + 1], world->hierarchy.sizes.data, world->hierarchy.sizes.size * sizeof(int));
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+static ecs_err_t restore_snapshot_state(ecs_world_t *world, snapshot_state_t *state)
+{
+    snapshot_header_t *header = state->blobs[0].data;
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (header->element_sizes[i] != world->components[i].array.element_size)
+        {
+            return ECS_ERR;
+        }
+    }
+
+    vector_t *blob = &state->blobs[1];
+    if (set_blob(&world->entities, blob->data, blob->size / sizeof(entity_info_t)))
+    {
+        return ECS_ERR_MEM;
+    }
+    sparse_map_clear(&world->entity_to_index_map);
+    for (int i = 0; i < world->entities.size; ++i)
+    {
+        sparse_map_insert(&world->entity_to_index_map, ((entity_info_t *)world->entities.data)[i].entity, i);
+    }
+    if (rebuild_inactive_entities(world) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    blob = &state->blobs[2];
+    if (set_blob(&world->recycled_entities, blob->data, blob->size / sizeof(ecs_entity_t)))
+    {
+        return ECS_ERR_MEM;
+    }
+    world->recycled_available = world->recycled_entities.size;
+    world->next_entities = header->next_entities;
+    world->flushed_next_entities = header->next_entities;
+
+    invalidate_spatial_indices(world);
+
+    blob = &state->blobs[SNAPSHOT_HIERARCHY_BLOB];
+    if (set_blob(&world->hierarchy.entities, blob->data, blob->size / sizeof(ecs_entity_t)) ||
+            set_blob(&world->hierarchy.sizes, blob[1].data, blob[1].size / sizeof(int)) ||
+            rebuild_hierarchy_maps(&world->hierarchy) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        component_info_t *comp_info = &world->components[i];
+        size_t element_size = comp_info->array.element_size;
+        if (element_size == 0)
+        {
+            continue;
+        }
+
+        vector_t *blobs = &state->blobs[3 + 3 * i];
+        int count = blobs[0].size / element_size;
+        mark_chunks_stale(comp_info, 0, comp_info->array.size > count ? comp_info->array.size : count);
+        if (pool_reserve(comp_info, count) != ECS_OK || set_blob(&comp_info->entities, blobs[1].data, count))
+        {
+            return ECS_ERR_MEM;
+        }
+        comp_info->key_sorted &= count <= comp_info->array.size;
+        comp_info->array.size = count;
+        if (count > 0)
+        {
+            memcpy(comp_info->array.data, blobs[0].data, blobs[0].size);
+        }
+
+        sparse_map_clear(&comp_info->entity_to_index_map);
+        for (int j = 0; j < count; ++j)
+        {
+            sparse_map_insert(&comp_info->entity_to_index_map, ((ecs_entity_t *)comp_info->entities.data)[j], j);
+        }
+        if (comp_info->double_buffered)
+        {
+            sync_previous_slots(comp_info, 0);
+        }
+
+        if (blobs[2].size == 0)
+        {
+            free(comp_info->resource);
+            comp_info->resource = NULL;
+        }
+        else if (comp_info->resource || (comp_info->resource = malloc(element_size)))
+        {
+            memcpy(comp_info->resource, blobs[2].data, element_size);
+        }
+
+        // Value indices are rebuilt over the restored pools
+        if (comp_info->index_count > 0)
+        {
+            for (int j = 0; j < world->indices.size; ++j)
+            {
+                index_info_t *index_info;
+                vector_get(&world->indices, j, (void **)&index_info);
+                if (index_info->used && index_info->component == i)
+                {
+                    clear_index(index_info);
+                }
+            }
+            if (index_components(world, i, 0, count) != ECS_OK)
+            {
+                return ECS_ERR_MEM;
+            }
+        }
+    }
+
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        if (query_info->used)
+        {
+            query_info->entities.size = 0;
+            sparse_map_clear(&query_info->entity_to_index_map);
+            populate_query(world, query_info);
+        }
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_set_snapshot_capacity(ecs_world_t *world, int frames)
+{
+    if (frames == 1 || frames < 0)
+    {
+        return ECS_ERR;
+    }
+
+    // The history is cleared
+    snapshot_ring_t *ring = world->snapshots;
+    if (ring)
+    {
+        free_snapshot_state(&ring->keyframe);
+        free_snapshot_state(&ring->latest);
+        free_snapshot_state(&ring->scratch);
+        for (int i = 0; i < ring->capacity; ++i)
+        {
+            vector_free(&ring->deltas[i]);
+        }
+        free(ring->deltas);
+        free(ring);
+        world->snapshots = NULL;
+    }
+    if (frames == 0)
+    {
+        return ECS_OK;
+    }
+
+    ring = calloc(1, sizeof(snapshot_ring_t));
+    if (ring == NULL || (ring->deltas = calloc(frames, sizeof(vector_t))) == NULL)
+    {
+        free(ring);
+        return ECS_ERR_MEM;
+    }
+    ring->capacity = frames;
+    init_snapshot_state(&ring->keyframe);
+    init_snapshot_state(&ring->latest);
+    init_snapshot_state(&ring->scratch);
+    for (int i = 0; i < frames; ++i)
+    {
+        vector_init(&ring->deltas[i], 1, 0);
+    }
+    world->snapshots = ring;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_take_snapshot(ecs_world_t *world, uint64_t *frame)
+{
+    snapshot_ring_t *ring = world->snapshots;
+    if (ring == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    // Raw bytes cannot stand for components with hooks or pooled buffers
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        ecs_component_hooks_t *hooks = &world->components[i].hooks;
+        if (world->components[i].buffer || hooks->ctor || hooks->dtor || hooks->move || hooks->copy)
+        {
+            return ECS_ERR;
+        }
+    }
+
+    if (flush_reserved_entities(world) != ECS_OK || capture_snapshot_state(world, &ring->scratch) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    if (ring->count == 0)
+    {
+        if (copy_snapshot_state(&ring->keyframe, &ring->scratch) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+    else
+    {
+        // The oldest delta is folded into the keyframe when the ring is full
+        if (ring->count == ring->capacity)
+        {
+            if (apply_snapshot_delta(&ring->keyframe, &ring->deltas[ring->head]) != ECS_OK)
+            {
+                return ECS_ERR_MEM;
+            }
+            ring->deltas[ring->head].size = 0;
+            ring->head = (ring->head + 1) % ring->capacity;
+            ++ring->first_frame;
+            --ring->count;
+        }
+
+        // Only the changed bytes are kept
+        vector_t *delta = &ring->deltas[(ring->head + ring->count - 1) % ring->capacity];
+        delta->size = 0;
+        for (int i = 0; i < SNAPSHOT_BLOB_COUNT; ++i)
+        {
+            vector_t *prev = &ring->latest.blobs[i], *cur = &ring->scratch.blobs[i];
+            if (xor_delta_encode(delta, prev->data, prev->size, cur->data, cur->size))
+            {
+                return ECS_ERR_MEM;
+            }
+        }
+    }
+
+    snapshot_state_t latest = ring->latest;
+    ring->latest = ring->scratch;
+    ring->scratch = latest;
+    *frame = ring->first_frame + ring->count++;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_restore_snapshot(ecs_world_t *world, uint64_t frame)
+{
+    snapshot_ring_t *ring = world->snapshots;
+    if (ring == NULL || frame < ring->first_frame || frame >= ring->first_frame + ring->count)
+    {
+        return ECS_ERR_NULL;
+    }
+    if (world->forked)
+    {
+        return ECS_ERR;
+    }
+    if (flush_reserved_entities(world) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    if (frame == ring->first_frame + ring->count - 1)
+    {
+        return restore_snapshot_state(world, &ring->latest);
+    }
+
+    // Replay the deltas over a copy of the keyframe
+    if (copy_snapshot_state(&ring->scratch, &ring->keyframe) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+    for (uint64_t i = 0; i < frame - ring->first_frame; ++i)
+    {
+        if (apply_snapshot_delta(&ring->scratch, &ring->deltas[(ring->head + i) % ring->capacity]) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    return restore_snapshot_state(world, &ring->scratch);
+}
+
+ecs_err_t ecs_world_get_snapshot_range(ecs_world_t *world, uint64_t *first, uint64_t *last, size_t *bytes)
+{
+    snapshot_ring_t *ring = world->snapshots;
+    if (ring == NULL || ring->count == 0)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    *first = ring->first_frame;
+    *last = ring->first_frame + ring->count - 1;
+
+    // Memory held by the keyframe and the deltas
+    if (bytes)
+    {
+        size_t size = 0;
+        for (int i = 0; i < SNAPSHOT_BLOB_COUNT; ++i)
+        {
+            size += ring->keyframe.blobs[i].size;
+        }
+        for (int i = 0; i < ring->capacity; ++i)
+        {
+            size += ring->deltas[i].size;
+        }
+        *bytes = size;
+    }
+
+    return ECS_OK;
+}
+
+// Slot bytes are hashed with the entity, so the sum over a pool does not
+// depend on the order of the slots
+static uint64_t hash_slot(const void *data, size_t size, ecs_entity_t entity)
+{
+    const uint8_t *bytes = data;
+    uint64_t hash = hash_key(entity ^ 0x9e3779b97f4a7c15ull);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = hash_key(hash ^ word);
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+
+    return hash_key(hash ^ tail ^ (uint64_t)size << 56);
+}
+
+static ecs_err_t update_checksum(component_info_t *comp_info)
+{
+    int chunk_count = comp_info->stale_chunks.size * 64;
+    int old_size = comp_info->chunk_hashes.size;
+    if (chunk_count > old_size)
+    {
+        if (vector_resize(&comp_info->chunk_hashes, chunk_count))
+        {
+            return ECS_ERR_MEM;
+        }
+        memset((uint64_t *)comp_info->chunk_hashes.data + old_size, 0, (chunk_count - old_size) * sizeof(uint64_t));
+    }
+
+    size_t element_size = comp_info->array.element_size;
+    uint64_t *stale_chunks = comp_info->stale_chunks.data;
+    uint64_t *chunk_hashes = comp_info->chunk_hashes.data;
+    for (int word = 0; word < comp_info->stale_chunks.size; ++word)
+    {
+        while (stale_chunks[word])
+        {
+            int chunk = word * 64 + __builtin_ctzll(stale_chunks[word]);
+            stale_chunks[word] &= stale_chunks[word] - 1;
+
+            // Slots past the end of the pool hash to 0
+            uint64_t hash = 0;
+            int end = (chunk + 1) * CHUNK_SIZE < comp_info->array.size ? (chunk + 1) * CHUNK_SIZE : comp_info->array.size;
+            for (int i = chunk * CHUNK_SIZE; i < end; ++i)
+            {
+                // Buffers hash their elements, not the block they live in
+                // nor the stale bytes past their count
+                void *comp = (char *)comp_info->array.data + i * element_size;
+                ecs_entity_t entity = ((ecs_entity_t *)comp_info->entities.data)[i];
+                if (comp_info->buffer)
+                {
+                    buffer_header_t *header = comp;
+                    hash += hash_slot(buffer_data(comp_info->buffer, header), header->count * comp_info->buffer->element_size, entity);
+                }
+                else
+                {
+                    hash += hash_slot(comp, element_size, entity);
+                }
+            }
+
+            comp_info->checksum += hash - chunk_hashes[chunk];
+            chunk_hashes[chunk] = hash;
+        }
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_checksum(ecs_world_t *world, uint64_t *checksum)
+{
+    if (flush_reserved_entities(world) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // Pools are combined in component order
+    uint64_t hash = hash_key(world->entities.size);
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        component_info_t *comp_info = &world->components[i];
+        size_t element_size = comp_info->array.element_size;
+        if (element_size == 0)
+        {
+            continue;
+        }
+        if (update_checksum(comp_info) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+
+        hash = hash_key(hash ^ i);
+        hash = hash_key(hash ^ comp_info->checksum);
+        hash = hash_key(hash ^ (comp_info->resource ? hash_slot(comp_info->resource, element_size, 0) : 0));
+    }
+    *checksum = hash;
+
+    return ECS_OK;
+}
+
+query_info_t *get_query_info(ecs_world_t *world, ecs_query_t query)
+{
+    if (query == 0 || query > world->queries.size)
+    {
+        return NULL;
+    }
+
+    query_info_t *query_info;
+    vector_get(&world->queries, query - 1, (void **)&query_info);
+
+    return query_info->used ? query_info : NULL;
+}
+
+void populate_query(ecs_world_t *world, query_info_t *query_info)
+{
+    // Match the existing entities
+    query_info->enabled_stale = true;
+    for (int i = 0; i < world->entities.size; ++i)
+    {
+        entity_info_t *entity_info;
+        vector_get(&world->entities, i, (void **)&entity_info);
+        if (query_matches(query_info, entity_info->signature))
+        {
+            vector_push_back(&query_info->entities, &entity_info->entity);
+            sparse_map_insert(&query_info->entity_to_index_map, entity_info->entity, query_info->entities.size - 1);
+        }
+    }
+}
+
+ecs_err_t ecs_world_create_query(ecs_world_t *world, ecs_query_t *query, ecs_signature_t with, ecs_signature_t without, ecs_signature_t optional)
+{
+    if (with & without)
+    {
+        return ECS_ERR;
+    }
+
+    // Share an existing query with the same terms
+    int query_ind = world->queries.size;
+    for (int i = world->queries.size - 1; i >= 0; --i)
+    {
+        query_info_t *query_info;
+        vector_get(&world->queries, i, (void **)&query_info);
+        if (query_info->used && query_info->with == with && query_info->without == without && query_info->optional == optional)
+        {
+            ++query_info->refs;
+            *query = i + 1;
+            return ECS_OK;
+        }
+        if (!query_info->used)
+        {
+            query_ind = i;
+        }
+    }
+
+    if (query_ind == world->queries.size && vector_push_back(&world->queries, &(query_info_t){ 0 }))
+    {
+        return ECS_ERR_MEM;
+    }
+
+    query_info_t *query_info;
+    vector_get(&world->queries, query_ind, (void **)&query_info);
+    *query_info = (query_info_t){ .used=true, .refs=1, .with=with, .without=without, .optional=optional };
+    sparse_map_init(&query_info->entity_to_index_map);
+    if (vector_init(&query_info->entities, sizeof(ecs_entity_t), 1))
+    {
+        query_info->used = false;
+        return ECS_ERR_MEM;
+    }
+    if (vector_init(&query_info->enabled, sizeof(uint64_t), 0))
+    {
+        vector_free(&query_info->entities);
+        query_info->used = false;
+        return ECS_ERR_MEM;
+    }
+
+    populate_query(world, query_info);
+
+    *query = query_ind + 1;
+
+    return ECS_OK;
+}
+
+static int count_query_systems(ecs_world_t *world, ecs_query_t query)
+{
+    int count = 0;
+    for (int i = 0; i < world->systems.size; ++i)
+    {
+        count += ((system_info_t *)world->systems.data)[i].query == query;
+    }
+
+    return count;
+}
+
+static void release_query(query_info_t *query_info)
+{
+    if (--query_info->refs > 0)
+    {
+        return;
+    }
+
+    vector_free(&query_info->entities);
+    vector_free(&query_info->enabled);
+    sparse_map_destroy(&query_info->entity_to_index_map);
+    journal_stop(&query_info->entities_journal);
+    query_info->used = false;
+}
+
+// References held by systems are released by unregistering them only
+ecs_err_t ecs_world_free_query(ecs_world_t *world, ecs_query_t query)
+{
+    query_info_t *query_info = get_query_info(world, query);
+    if (query_info == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+    if (query_info->refs <= count_query_systems(world, query))
+    {
+        return ECS_ERR;
+    }
+
+    release_query(query_info);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_query_entities(ecs_world_t *world, ecs_query_t query, ecs_entity_t **entities, int *count)
+{
+    query_info_t *query_info = get_query_info(world, query);
+    if (query_info == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+    if (rebuild_enabled_bits(world, query_info) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // The query's own list while none of its entities is disabled
+    int size = query_info->entities.size, run;
+    int first = next_enabled_run(query_info, 0, size, &run);
+    *entities = query_info->entities.data;
+    *count = size;
+    if (run == size)
+    {
+        return ECS_OK;
+    }
+
+    // The list handed out by the previous call for the query is given back
+    // when nothing was allocated after it, repeated calls reuse the memory
+    scratch_arena_t *scratch = get_scratch(world);
+    if (query_copy.world == world->uid && query_copy.query == query && query_copy.scratch == scratch &&
+            query_copy.resets == scratch->resets && query_copy.used == scratch->used)
+    {
+        scratch_arena_pop(scratch, query_copy.size);
+    }
+
+    size_t used = scratch->used;
+    ecs_entity_t *active = scratch_arena_alloc(scratch, size * sizeof(ecs_entity_t));
+    if (active == NULL)
+    {
+        *entities = NULL;
+        *count = 0;
+        return ECS_ERR_MEM;
+    }
+    query_copy = (query_copy_t){ world->uid, query, scratch, scratch->resets, scratch->used, scratch->used - used };
+
+    int active_count = 0;
+    for (; run > 0; first = next_enabled_run(query_info, first + run, size, &run))
+    {
+        memcpy(active + active_count, (ecs_entity_t *)query_info->entities.data + first, run * sizeof(ecs_entity_t));
+        active_count += run;
+    }
+    *entities = active;
+    *count = active_count;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_register_system(ecs_world_t *world, ecs_system_t system, ecs_signature_t signature, ecs_system_event_t event)
+{
+    ecs_query_t query;
+    ecs_err_t ret = ecs_world_create_query(world, &query, signature, 0, 0);
+    if (ret != ECS_OK)
+    {
+        return ret;
+    }
+
+    ret = ecs_world_register_query_system(world, system, query, event);
+
+    // The system holds its own reference
+    ecs_world_free_query(world, query);
+
+    return ret;
+}
+
+ecs_err_t ecs_world_register_query_system(ecs_world_t *world, ecs_system_t system, ecs_query_t query, ecs_system_event_t event)
+{
+    return ecs_world_register_scheduled_system(world, system, query, event, NULL);
+}
+
+ecs_err_t ecs_world_register_scheduled_system(ecs_world_t *world, ecs_system_t system, ecs_query_t query, ecs_system_event_t event, const ecs_system_config_t *config)
+{
+    if (config && (config->interval < 0 || config->phase < 0 || config->slices < 0))
+    {
+        return ECS_ERR;
+    }
+
+    if (uiptrtoi_map_get(&world->system_to_index_map, (uintptr_t)system, NULL))
+    {
+        return ECS_ERR_EXISTS;
+    }
+
+    query_info_t *query_info = get_query_info(world, query);
+    if (query_info == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+    ++query_info->refs;
+
+    system_info_t nsys = { .system=system, .event=event, .signature=query_info->with, .query=query };
+    if (config)
+    {
+        nsys.config = *config;
+    }
+    vector_push_back(&world->systems, &nsys);
+    uiptrtoi_map_insert(&world->system_to_index_map, (uintptr_t)system, world->systems.size - 1);
+    world->plans_dirty = true;
+
+    switch (event)
+    {
+        case ECS_SYSTEM_ON_INIT:
+            vector_push_back(&world->on_init_system_indices, &((int){ world->systems.size - 1 }));
+            break;
+        case ECS_SYSTEM_ON_UPDATE:
+            vector_push_back(&world->on_update_system_indices, &((int){ world->systems.size - 1 }));
+            break;
+        case ECS_SYSTEM_ON_END:
+            vector_push_back(&world->on_end_system_indices, &((int){ world->systems.size - 1 }));
+            break;
+        default: break;
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_unregister_system(ecs_world_t *world, ecs_system_t system)
+{
+    int sys_info_id;
+    if (!uiptrtoi_map_get(&world->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    system_info_t *sys_info;
+    vector_get(&world->systems, sys_info_id, (void **)&sys_info);
+
+    free(sys_info->args);
+    release_query(get_query_info(world, sys_info->query));
+    vector_remove(&world->systems, sys_info_id);
+    uiptrtoi_map_remove(&world->system_to_index_map, (uintptr_t)system);
+
+    // Shift the indices of the following systems
+    for (int event = 0; event < ECS_SYSTEM_EVENT_COUNT; ++event)
+    {
+        vector_t *sys_indices = get_event_system_indices(world, event);
+        int *indices = sys_indices->data;
+        int count = 0;
+        for (int i = 0; i < sys_indices->size; ++i)
+        {
+            if (indices[i] != sys_info_id)
+            {
+                indices[count++] = indices[i] > sys_info_id ? indices[i] - 1 : indices[i];
+            }
+        }
+        sys_indices->size = count;
+    }
+
+    for (int i = sys_info_id; i < world->systems.size; ++i)
+    {
+        vector_get(&world->systems, i, (void **)&sys_info);
+        uiptrtoi_map_remove(&world->system_to_index_map, (uintptr_t)sys_info->system);
+        uiptrtoi_map_insert(&world->system_to_index_map, (uintptr_t)sys_info->system, i);
+    }
+    world->plans_dirty = true;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_set_system_parameters(ecs_world_t *world, ecs_system_t system, int argc, void *argv[])
+{
+    int sys_info_id;
+    if (!uiptrtoi_map_get(&world->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    system_info_t *sys_info;
+    vector_get(&world->systems, sys_info_id, (void **)&sys_info);
+
+    void **args = realloc(sys_info->args, sizeof(void *) * argc);
+    if (args == NULL && argc > 0)
+    {
+        return ECS_ERR_MEM;
+    }
+    memcpy(args, argv, sizeof(void *) * argc);
+    sys_info->args = args;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_set_system_resources(ecs_world_t *world, ecs_system_t system, ecs_signature_t read, ecs_signature_t write)
+{
+    int sys_info_id;
+    if (!uiptrtoi_map_get(&world->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    system_info_t *sys_info;
+    vector_get(&world->systems, sys_info_id, (void **)&sys_info);
+
+    // A written resource is also read
+    sys_info->resource_read = read | write;
+    sys_info->resource_write = write;
+    world->plans_dirty = true;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_set_system_events(ecs_world_t *world, ecs_system_t system, ecs_signature_t publish, ecs_signature_t consume)
+{
+    int sys_info_id;
+    if (!uiptrtoi_map_get(&world->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    system_info_t *sys_info;
+    vector_get(&world->systems, sys_info_id, (void **)&sys_info);
+
+    sys_info->events_published = publish;
+    sys_info->events_consumed = consume;
+    world->plans_dirty = true;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_call_system(ecs_world_t *world, ecs_system_t system)
+{
+    int sys_info_id;
+    if (!uiptrtoi_map_get(&world->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    system_info_t *sys_info;
+    vector_get(&world->systems, sys_info_id, (void **)&sys_info);
+
+    query_info_t *query_info = get_query_info(world, sys_info->query);
+
+    // Systems use the bound API on the world that runs them
+    ecs_world_t *bound_world = cs;
+    cs = world;
+    ecs_err_t ret = rebuild_enabled_bits(world, query_info);
+    if (ret == ECS_OK)
+    {
+        run_system(world, sys_info, query_info, 0, query_info->entities.size);
+    }
+    cs = bound_world;
+
+    return ret;
+}
+
+static inline uint64_t get_time_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Called on each run of enabled entities in [first, end) of the query, on
+// the whole range while none is disabled and once with no entity when all
+// are. The bits are read again between calls as systems may change them.
+void run_system(ecs_world_t *world, system_info_t *sys_info, query_info_t *query_info, int first, int end)
+{
+    uint64_t start = get_time_ns();
+    int count = 0, run;
+    first = next_enabled_run(query_info, first, end, &run);
+    sys_info->status = ECS_OK;
+    do
+    {
+        ecs_err_t status = sys_info->system((ecs_entity_t *)query_info->entities.data + first, run, sys_info->args);
+        if (sys_info->status == ECS_OK)
+        {
+            sys_info->status = status;
+        }
+        count += run;
+        if (rebuild_enabled_bits(world, query_info) != ECS_OK)
+        {
+            sys_info->status = ECS_ERR_MEM;
+            break;
+        }
+        end = end < query_info->entities.size ? end : query_info->entities.size;
+        first = next_enabled_run(query_info, first + run, end, &run);
+    } while (run > 0);
+    uint64_t time = get_time_ns() - start;
+
+    ecs_system_stats_t *stats = &sys_info->stats;
+    ++stats->runs;
+    stats->entities += count;
+    stats->time_ns += time;
+    stats->last_count = count;
+    stats->last_time_ns = time;
+}
+
+void schedule_system(ecs_world_t *world, system_info_t *sys_info, uint64_t pass)
+{
+    // Rate limited systems only run on their phase
+    int interval = sys_info->config.interval;
+    if (interval > 1 && pass % interval != sys_info->config.phase % interval)
+    {
+        return;
+    }
+
+    query_info_t *query_info = get_query_info(world, sys_info->query);
+    if (rebuild_enabled_bits(world, query_info) != ECS_OK)
+    {
+        sys_info->status = ECS_ERR_MEM;
+        return;
+    }
+
+    // Amortised systems run over a rotating slice of their entities, the
+    // disabled ones being skipped within the slice
+    int count = query_info->entities.size, offset = 0;
+    int slices = sys_info->config.slices;
+    if (slices > 1)
+    {
+        int slice_size = (count + slices - 1) / slices;
+        if (sys_info->slice >= slices || sys_info->slice * slice_size >= count)
+        {
+            sys_info->slice = 0;
+        }
+
+        offset = sys_info->slice * slice_size;
+        count = count - offset < slice_size ? count - offset : slice_size;
+        sys_info->stats.last_offset = offset;
+        sys_info->slice = (sys_info->slice + 1) % slices;
+    }
+
+    run_system(world, sys_info, query_info, offset, offset + count);
+}
+
+vector_t *get_event_system_indices(ecs_world_t *world, ecs_system_event_t event)
+{
+    switch (event) 
+    {
+        case ECS_SYSTEM_ON_INIT:
+            return &world->on_init_system_indices;
+        case ECS_SYSTEM_ON_UPDATE:
+            return &world->on_update_system_indices;
+        case ECS_SYSTEM_ON_END:
+            return &world->on_end_system_indices;
+        default:
+            return NULL;
+    }
+}
+
+static bool can_fuse(plan_t *plan, plan_step_t *step, system_info_t *sys_info)
+{
+    if (!step->fusable || step->query != sys_info->query)
+    {
+        return false;
+    }
+
+    // Chunk interleaving must not change what the systems observe
+    system_info_t **systems = (system_info_t **)plan->systems.data + step->first;
+    for (int i = 0; i < step->count; ++i)
+    {
+        if ((systems[i]->resource_write & sys_info->resource_read) || (sys_info->resource_write & systems[i]->resource_read))
+        {
+            return false;
+        }
+        if ((systems[i]->events_published & sys_info->events_consumed) || (sys_info->events_published & systems[i]->events_consumed))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+ecs_err_t build_plan(ecs_world_t *world, ecs_system_event_t event)
+{
+    vector_t *sys_indices = get_event_system_indices(world, event);
+    plan_t *plan = &world->plans[event];
+    plan->steps.size = 0;
+    plan->systems.size = 0;
+
+    int pending_count = sys_indices->size;
+    system_info_t *pending[pending_count > 0 ? pending_count : 1];
+    for (int i = 0; i < pending_count; ++i)
+    {
+        int sys_id;
+        vector_get_copy(sys_indices, i, &sys_id);
+        vector_get(&world->systems, sys_id, (void **)&pending[i]);
+    }
+
+    while (pending_count > 0)
+    {
+        // Take the first system in registration order whose consumed events
+        // have no pending producer, cycles fall back to registration order
+        int next = 0;
+        for (int i = 0; i < pending_count; ++i)
+        {
+            bool ready = true;
+            for (int j = 0; j < pending_count && ready; ++j)
+            {
+                ready = j == i || !(pending[j]->events_published & pending[i]->events_consumed);
+            }
+            if (ready)
+            {
+                next = i;
+                break;
+            }
+        }
+
+        system_info_t *sys_info = pending[next];
+        memmove(pending + next, pending + next + 1, (pending_count - next - 1) * sizeof(*pending));
+        --pending_count;
+        if (vector_push_back(&plan->systems, &sys_info))
+        {
+            return ECS_ERR_MEM;
+        }
+
+        // Only plain systems over the same query are fused
+        bool fusable = world->fusion_chunk_size > 0 && sys_info->config.interval <= 1 && sys_info->config.slices <= 1;
+        plan_step_t *last_step = NULL;
+        if (plan->steps.size > 0)
+        {
+            vector_get(&plan->steps, plan->steps.size - 1, (void **)&last_step);
+        }
+
+        if (fusable && last_step && can_fuse(plan, last_step, sys_info))
+        {
+            ++last_step->count;
+        }
+        else if (vector_push_back(&plan->steps, &(plan_step_t){ .query=sys_info->query, .fusable=fusable, .first=plan->systems.size - 1, .count=1 }))
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    return ECS_OK;
+}
+
+void run_fused_systems(ecs_world_t *world, system_info_t **systems, int system_count, ecs_query_t query)
+{
+    uint64_t times[system_count];
+    for (int i = 0; i < system_count; ++i)
+    {
+        systems[i]->status = ECS_OK;
+        times[i] = 0;
+    }
+
+    // Run every system on a chunk before moving to the next one, on each
+    // run of enabled entities within the chunk. The query is read again
+    // between calls as systems may change its entities.
+    query_info_t *query_info = get_query_info(world, query);
+    if (rebuild_enabled_bits(world, query_info) != ECS_OK)
+    {
+        for (int i = 0; i < system_count; ++i)
+        {
+            systems[i]->status = ECS_ERR_MEM;
+        }
+        return;
+    }
+
+    int chunk_size = world->fusion_chunk_size;
+    int counts[system_count];
+    memset(counts, 0, sizeof(counts));
+    for (int first = 0; first < query_info->entities.size; first += chunk_size)
+    {
+        for (int i = 0; i < system_count; ++i)
+        {
+            int end = first + chunk_size, run;
+            end = end < query_info->entities.size ? end : query_info->entities.size;
+            for (int from = next_enabled_run(query_info, first, end, &run); run > 0; from = next_enabled_run(query_info, from + run, end, &run))
+            {
+                uint64_t start = get_time_ns();
+                ecs_err_t status = systems[i]->system((ecs_entity_t *)query_info->entities.data + from, run, systems[i]->args);
+                times[i] += get_time_ns() - start;
+
+                if (systems[i]->status == ECS_OK)
+                {
+                    systems[i]->status = status;
+                }
+                counts[i] += run;
+                if (rebuild_enabled_bits(world, query_info) != ECS_OK)
+                {
+                    systems[i]->status = ECS_ERR_MEM;
+                    break;
+                }
+                end = end < query_info->entities.size ? end : query_info->entities.size;
+            }
+        }
+    }
+
+    for (int i = 0; i < system_count; ++i)
+    {
+        ecs_system_stats_t *stats = &systems[i]->stats;
+        ++stats->runs;
+        stats->entities += counts[i];
+        stats->time_ns += times[i];
+        stats->last_count = counts[i];
+        stats->last_offset = 0;
+        stats->last_time_ns = times[i];
+    }
+}
+
+ecs_err_t ecs_world_set_system_fusion(ecs_world_t *world, int chunk_size)
+{
+    if (chunk_size < 0)
+    {
+        return ECS_ERR;
+    }
+
+    world->fusion_chunk_size = chunk_size;
+    world->plans_dirty = true;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_listen_systems(ecs_world_t *world, ecs_system_event_t event)
+{
+    if (get_event_system_indices(world, event) == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    if (world->plans_dirty)
+    {
+        for (int i = 0; i < ECS_SYSTEM_EVENT_COUNT; ++i)
+        {
+            if (build_plan(world, i) != ECS_OK)
+            {
+                return ECS_ERR_MEM;
+            }
+        }
+        world->plans_dirty = false;
+    }
+
+    // Systems use the bound API on the world that runs them
+    ecs_world_t *bound_world = cs;
+    cs = world;
+    uint64_t pass = world->passes[event]++;
+    plan_t *plan = &world->plans[event];
+    plan_step_t *steps = plan->steps.data;
+    system_info_t **systems = plan->systems.data;
+    for (int i = 0; i < plan->steps.size; ++i)
+    {
+        if (steps[i].count == 1)
+        {
+            schedule_system(world, systems[steps[i].first], pass);
+        }
+        else
+        {
+            run_fused_systems(world, systems + steps[i].first, steps[i].count, steps[i].query);
+        }
+    }
+    cs = bound_world;
+
+    // Publish what the pass wrote to the double buffered components and
+    // event channels
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (world->components[i].double_buffered)
+        {
+            flip_component_buffers(&world->components[i]);
+        }
+        if (world->components[i].channel)
+        {
+            flip_event_channel(world->components[i].channel);
+        }
+    }
+
+    scratch_arena_reset(&world->scratch);
+    for (int i = 0; i < world->worker_scratch.size; ++i)
+    {
+        scratch_arena_reset((scratch_arena_t *)world->worker_scratch.data + i);
+    }
+
+    // Entities reserved by the systems are created at the end of the pass
+    return flush_reserved_entities(world);
+}
+
+// Workers of a parallel for over the world each use their own arena
+static scratch_arena_t *get_scratch(ecs_world_t *world)
+{
+    return worker_scratch && cs == world ? worker_scratch : &world->scratch;
+}
+
+void *ecs_world_scratch_alloc(ecs_world_t *world, size_t size)
+{
+    return scratch_arena_alloc(get_scratch(world), size);
+}
+
+ecs_err_t ecs_world_reserve_scratch(ecs_world_t *world, size_t size)
+{
+    // The extra block is merged with the others at the next reset
+    scratch_arena_t *scratch = get_scratch(world);
+    if (scratch->capacity >= size)
+    {
+        return ECS_OK;
+    }
+    if (scratch->used == 0)
+    {
+        scratch_arena_free_blocks(scratch);
+    }
+
+    return scratch_arena_add_block(scratch, size - scratch->capacity) ? ECS_ERR_MEM : ECS_OK;
+}
+
+ecs_err_t ecs_world_get_scratch_stats(ecs_world_t *world, ecs_scratch_stats_t *stats)
+{
+    scratch_arena_t *scratch = get_scratch(world);
+    stats->used = scratch->used;
+    stats->capacity = scratch->capacity;
+    stats->high_water = scratch->high_water;
+
+    return ECS_OK;
+}
+
+// Created on first use, NULL when out of resources
+worker_pool_t *get_worker_pool(ecs_world_t *world)
+{
+    if (world->workers == NULL)
+    {
+        world->workers = malloc(sizeof(worker_pool_t));
+        if (world->workers == NULL || worker_pool_init(world->workers))
+        {
+            free(world->workers);
+            world->workers = NULL;
+        }
+    }
+
+    return world->workers;
+}
+
+static void detect_numa_topology()
+{
+    numa_topology_detect(&numa_topology);
+}
+
+static const numa_topology_t *get_numa_topology()
+{
+    pthread_once(&numa_once, detect_numa_topology);
+
+    return &numa_topology;
+}
+
+ecs_err_t ecs_world_set_numa_mode(ecs_world_t *world, bool enabled)
+{
+    world->numa = enabled;
+
+    return ECS_OK;
+}
+
+typedef struct
+{
+    ecs_world_t *world;
+    component_info_t *comp_info;
+    int workers;
+    int nodes;
+    bool numa;
+    bool nested;
+    ecs_parallel_fn_t fn;
+    void *ctx;
+
+    // Pool being placed, each worker moving its own slice in a first run
+    // over the pool, before any worker calls `fn`
+    void *placement;
+    bool placing;
+} parallel_for_t;
+
+// Workers are spread evenly over the nodes, in order, so that every node
+// processes a contiguous range of slots
+static int worker_node(int worker, int workers, int nodes)
+{
+    return (int64_t)worker * nodes / workers;
+}
+
+static void run_parallel_task(void *arg, int worker, bool threaded)
+{
+    parallel_for_t *job = arg;
+    component_info_t *comp_info = job->comp_info;
+    size_t element_size = comp_info->array.element_size;
+    int first = (int64_t)comp_info->array.size * worker / job->workers;
+    int count = (int64_t)comp_info->array.size * (worker + 1) / job->workers - first;
+
+    // Pool threads stay pinned between calls, until their node changes
+    int node = worker_node(worker, job->workers, job->nodes);
+    if (job->numa && threaded && pinned_node != node && numa_pin_thread(&numa_topology, node) == 0)
+    {
+        pinned_node = node;
+    }
+
+    char *data = (char *)comp_info->array.data + first * element_size;
+    if (job->placing)
+    {
+        // First touch from the node of the worker
+        char *placed = (char *)job->placement + first * element_size;
+        if (comp_info->hooks.move && count > 0)
+        {
+            comp_info->hooks.move(placed, data, count);
+        }
+        else if (count > 0)
+        {
+            memcpy(placed, data, count * element_size);
+        }
+        return;
+    }
+
+    // Bound to the world with the arena of its index, the caller's binding
+    // is restored when it runs the task itself. Nested calls keep the
+    // arena of the enclosing worker.
+    ecs_world_t *bound = cs;
+    scratch_arena_t *bound_scratch = worker_scratch;
+    if (!job->nested)
+    {
+        cs = job->world;
+        worker_scratch = (scratch_arena_t *)job->world->worker_scratch.data + worker;
+    }
+    job->fn(data, (ecs_entity_t *)comp_info->entities.data + first, count, worker, job->ctx);
+    cs = bound;
+    worker_scratch = bound_scratch;
+}
+
+ecs_err_t ecs_world_parallel_for(ecs_world_t *world, int id, int workers, ecs_parallel_fn_t fn, void *ctx)
+{
+    ecs_column_t column;
+    if (fn == NULL || ecs_world_get_column(world, id, &column) != ECS_OK)
+    {
+        return ECS_ERR_NULL;
+    }
+    if (column.count == 0)
+    {
+        return ECS_OK;
+    }
+
+    component_info_t *comp_info = &world->components[id];
+    if (workers <= 0)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    workers = workers < column.count / PARALLEL_MIN_SLICE ? workers : column.count / PARALLEL_MIN_SLICE;
+    workers = workers > 0 ? workers : 1;
+
+    // Calls from a worker of the world run on the calling thread, the pool
+    // being busy with the enclosing call
+    bool nested = worker_scratch && cs == world;
+    workers = nested ? 1 : workers;
+    if (!nested && get_worker_pool(world) == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    vector_t *arenas = &world->worker_scratch;
+    int arena_count = arenas->size;
+    if (arena_count < workers)
+    {
+        if (vector_resize(arenas, workers))
+        {
+            return ECS_ERR_MEM;
+        }
+        for (int w = arena_count; w < workers; ++w)
+        {
+            scratch_arena_init((scratch_arena_t *)arenas->data + w);
+        }
+    }
+
+    // Single node machines run as without NUMA mode
+    const numa_topology_t *topology = get_numa_topology();
+    bool numa = world->numa && topology->node_count > 1 && !nested;
+    parallel_for_t job = { .world=world, .comp_info=comp_info, .workers=workers, .nodes=topology->node_count, .numa=numa,
+                           .nested=nested, .fn=fn, .ctx=ctx };
+    if (numa && (comp_info->placed_data != comp_info->array.data || comp_info->placed_capacity != comp_info->array.capacity ||
+                comp_info->placed_workers != workers))
+    {
+        // Pages of a fresh allocation are first touched by the workers,
+        // the pool is left in place when out of memory
+        job.placement = malloc(comp_info->array.capacity * comp_info->array.element_size);
+    }
+
+    // The pool is placed and swapped in before any worker runs, so `fn`
+    // reaches the same memory through the API
+    if (job.placement)
+    {
+        job.placing = true;
+        worker_pool_run(world->workers, 0, workers, run_parallel_task, &job);
+        job.placing = false;
+
+        free(comp_info->array.data);
+        comp_info->array.data = job.placement;
+        comp_info->placed_data = job.placement;
+        comp_info->placed_capacity = comp_info->array.capacity;
+        comp_info->placed_workers = workers;
+    }
+
+    // Pinned workers all run on the pool, the caller keeps its affinity
+    if (nested)
+    {
+        run_parallel_task(&job, 0, false);
+    }
+    else
+    {
+        worker_pool_run(world->workers, numa ? 0 : 1, workers, run_parallel_task, &job);
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_get_numa_occupancy(ecs_world_t *world, int id, size_t *bytes, int max_nodes, int *node_count)
+{
+    if (id < 0 || id >= ECS_MAX_COMPONENTS || world->components[id].array.element_size == 0)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    component_info_t *comp_info = &world->components[id];
+    const numa_topology_t *topology = get_numa_topology();
+    size_t element_size = comp_info->array.element_size;
+    size_t counts[NUMA_MAX_NODES] = { 0 };
+    if (topology->node_count == 1)
+    {
+        counts[0] = comp_info->array.size * element_size;
+    }
+    else if (numa_count_pages(topology, comp_info->array.data, comp_info->array.size * element_size, counts))
+    {
+        // The kernel cannot tell, the last placement is assumed to hold
+        bool placed = comp_info->placed_data == comp_info->array.data && comp_info->placed_capacity == comp_info->array.capacity;
+        int workers = placed ? comp_info->placed_workers : 1;
+        for (int w = 0; w < workers; ++w)
+        {
+            int first = (int64_t)comp_info->array.size * w / workers;
+            int last = (int64_t)comp_info->array.size * (w + 1) / workers;
+            counts[placed ? worker_node(w, workers, topology->node_count) : 0] += (last - first) * element_size;
+        }
+    }
+
+    for (int n = 0; n < max_nodes && n < topology->node_count; ++n)
+    {
+        bytes[n] = counts[n];
+    }
+    *node_count = topology->node_count;
+
+    return ECS_OK;
+}
+
+// Vectors holding over COMPACT_SLACK times their size give the slack back
+static ecs_err_t compact_vector(vector_t *vec, void (*move)(void *, void *, int))
+{
+    int capacity = vec->size > 0 ? vec->size : 1;
+    if (vec->capacity <= capacity * COMPACT_SLACK)
+    {
+        return ECS_OK;
+    }
+
+    void *ndata;
+    if (move == NULL)
+    {
+        ndata = realloc(vec->data, capacity * vec->element_size);
+    }
+    else
+    {
+        ndata = malloc(capacity * vec->element_size);
+        if (ndata != NULL && vec->size > 0)
+        {
+            move(ndata, vec->data, vec->size);
+        }
+        if (ndata != NULL)
+        {
+            free(vec->data);
+        }
+    }
+    if (ndata == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+    vec->data = ndata;
+    vec->capacity = capacity;
+
+    return ECS_OK;
+}
+
+// Drops the keys of entity ids past the last one
+static ecs_err_t trim_sparse_map(sparse_map_t *map, ecs_entity_t next_entities)
+{
+    if (map->values.size > (int)next_entities)
+    {
+        map->values.size = next_entities;
+    }
+
+    return compact_vector(&map->values, NULL);
+}
+
+// Sorts entity ids, along with their position when `order` is set
+static ecs_err_t sort_entity_ids(ecs_entity_t *entities, int count, uint32_t *order)
+{
+    bool sorted = true;
+    for (int i = 1; i < count && sorted; ++i)
+    {
+        sorted = entities[i - 1] < entities[i];
+    }
+    for (int i = 0; sorted && order && i < count; ++i)
+    {
+        order[i] = i;
+    }
+    if (sorted)
+    {
+        return ECS_OK;
+    }
+
+    uint64_t *keys = malloc(count * 2 * (sizeof(uint64_t) + sizeof(uint32_t)));
+    if (keys == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+    uint64_t *tmp_keys = keys + count;
+    uint32_t *positions = (uint32_t *)(tmp_keys + count);
+    uint32_t *tmp_positions = positions + count;
+    for (int i = 0; i < count; ++i)
+    {
+        keys[i] = entities[i];
+        positions[i] = i;
+    }
+
+    // Lists compacted on a previous pass are mostly sorted already
+    if (insertion_sort_u64(keys, positions, count, 4l * count))
+    {
+        radix_sort_u64(keys, positions, count, tmp_keys, tmp_positions);
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        entities[i] = keys[i];
+    }
+    if (order)
+    {
+        memcpy(order, positions, count * sizeof(uint32_t));
+    }
+    free(keys);
+
+    return ECS_OK;
+}
+
+// Ids past the highest live entity are dropped from the recycled ones, so
+// the maps keyed by entity shrink along
+static ecs_err_t compact_entities(ecs_world_t *world)
+{
+    ecs_entity_t next_entities = 1;
+    for (int i = 0; i < world->entities.size; ++i)
+    {
+        ecs_entity_t entity = ((entity_info_t *)world->entities.data)[i].entity;
+        next_entities = entity >= next_entities ? entity + 1 : next_entities;
+    }
+    if (next_entities < world->next_entities)
+    {
+        ecs_entity_t *recycled = world->recycled_entities.data;
+        int size = 0;
+        for (int i = 0; i < world->recycled_entities.size; ++i)
+        {
+            if (recycled[i] < next_entities)
+            {
+                recycled[size++] = recycled[i];
+            }
+        }
+        world->recycled_entities.size = size;
+        world->recycled_available = size;
+        world->next_entities = next_entities;
+        world->flushed_next_entities = next_entities;
+    }
+
+    // Bits past the last entity are all clear
+    if (world->inactive_entities.size > (int)next_entities / 64 + 1)
+    {
+        world->inactive_entities.size = next_entities / 64 + 1;
+    }
+
+    int ret = compact_vector(&world->entities, NULL);
+    ret |= compact_vector(&world->recycled_entities, NULL);
+    ret |= trim_sparse_map(&world->entity_to_index_map, next_entities);
+    ret |= compact_vector(&world->inactive_entities, NULL);
+    ret |= trim_sparse_map(&world->hierarchy.positions, next_entities);
+    ret |= trim_sparse_map(&world->hierarchy.parents, next_entities);
+    ret |= compact_vector(&world->hierarchy.entities, NULL);
+    ret |= compact_vector(&world->hierarchy.sizes, NULL);
+    ret |= compact_vector(&world->hierarchy.parent_indices, NULL);
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+// Swaps the next COMPACT_CHUNK slots of the pool being ordered into place,
+// slots already filled are never touched again. Stops at the end of the
+// pool, or when an entity of the order left it.
+static ecs_err_t reorder_pool_chunk(ecs_world_t *world, int comp_info_ind)
+{
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    size_t element_size = comp_info->array.element_size;
+    char *tmp = malloc(element_size);
+    if (tmp == NULL)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // Written slots move, their chunks are carried over at the next flip
+    bool dirty = false;
+    for (int i = 0; comp_info->double_buffered && i < comp_info->dirty_chunks.size && !dirty; ++i)
+    {
+        dirty = ((uint64_t *)comp_info->dirty_chunks.data)[i] != 0;
+    }
+    if (comp_info->double_buffered)
+    {
+        begin_previous_write(comp_info);
+    }
+
+    const ecs_entity_t *order = world->compact_order.data;
+    ecs_entity_t *entities = comp_info->entities.data;
+    int count = comp_info->array.size;
+    int last = world->compact_slot + COMPACT_CHUNK < count ? world->compact_slot + COMPACT_CHUNK : count;
+    int i = world->compact_slot;
+    for (int j; i < last && sparse_map_get(&comp_info->entity_to_index_map, order[i], &j); ++i)
+    {
+        if (j == i)
+        {
+            continue;
+        }
+
+        char *a = (char *)comp_info->array.data + i * element_size;
+        char *b = (char *)comp_info->array.data + j * element_size;
+        if (comp_info->hooks.move)
+        {
+            comp_info->hooks.move(tmp, a, 1);
+            comp_info->hooks.move(a, b, 1);
+            comp_info->hooks.move(b, tmp, 1);
+        }
+        else
+        {
+            memcpy(tmp, a, element_size);
+            memcpy(a, b, element_size);
+            memcpy(b, tmp, element_size);
+        }
+        if (comp_info->double_buffered)
+        {
+            a = (char *)comp_info->previous.data + i * element_size;
+            b = (char *)comp_info->previous.data + j * element_size;
+            memcpy(tmp, a, element_size);
+            memcpy(a, b, element_size);
+            memcpy(b, tmp, element_size);
+        }
+
+        ecs_entity_t entity = entities[i];
+        entities[i] = entities[j];
+        entities[j] = entity;
+        sparse_map_insert(&comp_info->entity_to_index_map, entities[i], i);
+        sparse_map_insert(&comp_info->entity_to_index_map, entities[j], j);
+        mark_chunks_stale(comp_info, i, 1);
+        mark_chunks_stale(comp_info, j, 1);
+        if (dirty)
+        {
+            mark_chunk_dirty(comp_info, i);
+            mark_chunk_dirty(comp_info, j);
+        }
+    }
+
+    if (comp_info->double_buffered)
+    {
+        end_previous_write(comp_info);
+    }
+    world->compact_slot = i < last ? count : last;
+    free(tmp);
+
+    return ECS_OK;
+}
+
+// Pools are ordered by entity id, so that pools iterated together and
+// their queries are walked in the same order. Large pools take several
+// steps, the next one resuming where the previous stopped.
+static ecs_err_t compact_component(ecs_world_t *world, int comp_info_ind)
+{
+    component_info_t *comp_info = &world->components[comp_info_ind];
+    vector_t *order = &world->compact_order;
+    int count = comp_info->array.size;
+
+    // Pools sorted by key or resized meanwhile start over
+    if (world->compact_pool == comp_info_ind && (comp_info->key_sorted || order->size != count))
+    {
+        world->compact_pool = -1;
+    }
+    if (world->compact_pool != comp_info_ind && !comp_info->key_sorted && count > 1)
+    {
+        if (vector_resize(order, count))
+        {
+            return ECS_ERR_MEM;
+        }
+        memcpy(order->data, comp_info->entities.data, count * sizeof(ecs_entity_t));
+        if (sort_entity_ids(order->data, count, NULL) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+        if (memcmp(order->data, comp_info->entities.data, count * sizeof(ecs_entity_t)) != 0)
+        {
+            world->compact_pool = comp_info_ind;
+            world->compact_slot = 0;
+        }
+    }
+    if (world->compact_pool == comp_info_ind)
+    {
+        if (reorder_pool_chunk(world, comp_info_ind) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+        if (world->compact_slot < count)
+        {
+            return ECS_OK;
+        }
+        world->compact_pool = -1;
+    }
+
+    order->size = 0;
+    int ret = compact_vector(order, NULL);
+    ret |= compact_vector(&comp_info->array, comp_info->hooks.move);
+    ret |= compact_vector(&comp_info->entities, NULL);
+    ret |= comp_info->double_buffered ? compact_vector(&comp_info->previous, NULL) : 0;
+    ret |= trim_sparse_map(&comp_info->entity_to_index_map, world->next_entities);
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+// Query lists follow the pools: by entity id, or as left by ecs_sort_component
+// when they require a pool sorted by key
+static ecs_err_t compact_query(ecs_world_t *world, query_info_t *query_info)
+{
+    bool key_sorted = false;
+    for (int i = 0; i < ECS_MAX_COMPONENTS && !key_sorted; ++i)
+    {
+        key_sorted = ((query_info->with >> i) & 1) && world->components[i].key_sorted;
+    }
+
+    ecs_entity_t *entities = query_info->entities.data;
+    if (!key_sorted)
+    {
+        if (sort_entity_ids(entities, query_info->entities.size, NULL) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+        for (int i = 0; i < query_info->entities.size; ++i)
+        {
+            sparse_map_insert(&query_info->entity_to_index_map, entities[i], i);
+        }
+        query_info->enabled_stale = true;
+    }
+
+    int ret = compact_vector(&query_info->entities, NULL);
+    ret |= trim_sparse_map(&query_info->entity_to_index_map, world->next_entities);
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+static ecs_err_t compact_index(ecs_world_t *world, index_info_t *index_info)
+{
+    if (index_info->entity_keys.size > (int)world->next_entities)
+    {
+        index_info->entity_keys.size = world->next_entities;
+    }
+
+    int ret = compact_vector(&index_info->entity_keys, NULL);
+    ret |= trim_sparse_map(&index_info->entity_to_slot_map, world->next_entities);
+    ret |= compact_vector(&index_info->sorted_keys, NULL);
+    ret |= compact_vector(&index_info->sorted_entities, NULL);
+    ret |= compact_vector(&index_info->pending, NULL);
+    for (int i = 0; i < index_info->groups.size; ++i)
+    {
+        ret |= compact_vector(&((index_group_t *)index_info->groups.data)[i].entities, NULL);
+    }
+    ret |= compact_vector(&index_info->groups, NULL);
+
+    // Buckets shrink back to the load factor of the live groups
+    int capacity = 16;
+    while (capacity < (index_info->groups.size + 1) * 2)
+    {
+        capacity *= 2;
+    }
+    if (index_info->bucket_capacity > capacity * COMPACT_SLACK)
+    {
+        ret |= resize_index_buckets(index_info, capacity);
+    }
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+// Removed and moved entries are merged by a rebuild
+static ecs_err_t compact_spatial_index(ecs_world_t *world, spatial_index_t *spatial)
+{
+    if (spatial->stale || spatial->tombstones > 0 || spatial->moved.size > 0)
+    {
+        if (update_spatial_indices(world, spatial->component) != ECS_OK || rebuild_spatial_index(world, spatial) != ECS_OK)
+        {
+            return ECS_ERR_MEM;
+        }
+    }
+
+    int ret = compact_vector(&spatial->entries, NULL);
+    ret |= compact_vector(&spatial->moved, NULL);
+    ret |= compact_vector(&spatial->results, NULL);
+    ret |= trim_sparse_map(&spatial->entity_to_entry_map, world->next_entities);
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+// Steps of a pass: the entities, then every pool, query, value index and
+// spatial index
+static ecs_err_t compact_step(ecs_world_t *world, int step)
+{
+    if (step == 0)
+    {
+        return compact_entities(world);
+    }
+    if ((step -= 1) < ECS_MAX_COMPONENTS)
+    {
+        return world->components[step].array.element_size ? compact_component(world, step) : ECS_OK;
+    }
+    if ((step -= ECS_MAX_COMPONENTS) < world->queries.size)
+    {
+        query_info_t *query_info = (query_info_t *)world->queries.data + step;
+        return query_info->used ? compact_query(world, query_info) : ECS_OK;
+    }
+    if ((step -= world->queries.size) < world->indices.size)
+    {
+        index_info_t *index_info = (index_info_t *)world->indices.data + step;
+        return index_info->used ? compact_index(world, index_info) : ECS_OK;
+    }
+    spatial_index_t *spatial = (spatial_index_t *)world->spatial_indices.data + step - world->indices.size;
+
+    return spatial->used ? compact_spatial_index(world, spatial) : ECS_OK;
+}
+
+ecs_err_t ecs_world_compact(ecs_world_t *world, int budget_us)
+{
+    if (world->forked)
+    {
+        return ECS_ERR;
+    }
+    if (flush_reserved_entities(world) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    // At least one step per call and at most one pass, a pool being ordered
+    // holding its step until its last chunk
+    uint64_t deadline = get_time_ns() + (uint64_t)(budget_us > 0 ? budget_us : 0) * 1000;
+    int steps = 1 + ECS_MAX_COMPONENTS + world->queries.size + world->indices.size + world->spatial_indices.size;
+    for (int i = 0; i < steps;)
+    {
+        int step = world->compact_step < steps ? world->compact_step : 0;
+        ecs_err_t ret = compact_step(world, step);
+        if (step == 0 || world->compact_pool != step - 1)
+        {
+            world->compact_step = (step + 1) % steps;
+            ++i;
+        }
+        if (ret != ECS_OK)
+        {
+            return ret;
+        }
+        if (budget_us > 0 && get_time_ns() >= deadline)
+        {
+            break;
+        }
+    }
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_reserve_entities(ecs_world_t *world, ecs_entity_t max_entities)
+{
+    if (max_entities > (ecs_entity_t)world->entities.capacity &&
+            vector_reserve(&world->entities, max_entities - world->entities.capacity))
+    {
+        return ECS_ERR_MEM;
+    }
+    if (max_entities > (ecs_entity_t)world->entity_to_index_map.values.capacity &&
+            vector_reserve(&world->entity_to_index_map.values, max_entities - world->entity_to_index_map.values.capacity))
+    {
+        return ECS_ERR_MEM;
+    }
+
+    return ECS_OK;
+}
+
+// The entity side of a compaction pass, pools keep their order
+ecs_err_t ecs_world_shrink_entities(ecs_world_t *world)
+{
+    if (world->forked)
+    {
+        return ECS_ERR;
+    }
+    if (flush_reserved_entities(world) != ECS_OK || compact_entities(world) != ECS_OK)
+    {
+        return ECS_ERR_MEM;
+    }
+
+    int ret = 0;
+    for (int i = 0; i < ECS_MAX_COMPONENTS; ++i)
+    {
+        if (world->components[i].array.element_size)
+        {
+            ret |= trim_sparse_map(&world->components[i].entity_to_index_map, world->next_entities);
+        }
+    }
+    for (int i = 0; i < world->queries.size; ++i)
+    {
+        query_info_t *query_info = (query_info_t *)world->queries.data + i;
+        ret |= query_info->used ? trim_sparse_map(&query_info->entity_to_index_map, world->next_entities) : 0;
+    }
+    for (int i = 0; i < world->indices.size; ++i)
+    {
+        index_info_t *index_info = (index_info_t *)world->indices.data + i;
+        ret |= index_info->used ? trim_sparse_map(&index_info->entity_to_slot_map, world->next_entities) : 0;
+    }
+    for (int i = 0; i < world->spatial_indices.size; ++i)
+    {
+        spatial_index_t *spatial = (spatial_index_t *)world->spatial_indices.data + i;
+        ret |= spatial->used ? trim_sparse_map(&spatial->entity_to_entry_map, world->next_entities) : 0;
+    }
+
+    return ret ? ECS_ERR_MEM : ECS_OK;
+}
+
+ecs_err_t ecs_world_create_signature_by_names(ecs_world_t *world, ecs_signature_t *signature, const char *names)
+{
+    char *names_cpy = strdup(names);
+    if (names_cpy == NULL)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    ecs_signature_t sign = 0;
+    char *saveptr;
+    char *name = strtok_r(names_cpy, ",", &saveptr);
+    while (name != NULL)
+    {
+        while (*name == ' ') name++;
+        int ind;
+        if (!stoi_map_get(&world->component_name_to_index_map, name, &ind))
+        {
+            free(names_cpy);
+            return ECS_ERR_NULL;
+        }
+
+        sign |= (1 << ind);
+        name = strtok_r(NULL, ",", &saveptr);
+    }
+
+    *signature = sign;
+
+    free(names_cpy);
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_get_system_status(ecs_world_t *world, ecs_system_t system, ecs_err_t *ret)
+{
+    int sys_info_id;
+    if (!uiptrtoi_map_get(&world->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    system_info_t *sys_info;
+    vector_get(&world->systems, sys_info_id, (void **)&sys_info);
+
+    *ret = sys_info->status;
+
+    return ECS_OK;
+}
+
+ecs_err_t ecs_world_get_system_stats(ecs_world_t *world, ecs_system_t system, ecs_system_stats_t *stats)
+{
+    int sys_info_id;
+    if (!uiptrtoi_map_get(&world->system_to_index_map, (uintptr_t)system, &sys_info_id))
+    {
+        return ECS_ERR_NULL;
+    }
+
+    system_info_t *sys_info;
+    vector_get(&world->systems, sys_info_id, (void **)&sys_info);
+
+    *stats = sys_info->stats;
+
+    return ECS_OK;
+}
+
+//------------------------------------------------------------------------------
+// Bound Scene Wrappers
+//------------------------------------------------------------------------------
+ecs_err_t ecs_register_component_by_name(const char *name, size_t size)
+{
+    return ecs_world_register_component_by_name(cs, name, size);
+}
+
+ecs_err_t ecs_unregister_component_by_name(const char *name)
+{
+    return ecs_world_unregister_component_by_name(cs, name);
+}
+
+ecs_err_t ecs_create_entity(ecs_entity_t *entity)
+{
+    return ecs_world_create_entity(cs, entity);
+}
+
+ecs_err_t ecs_reserve_entity_ids(int count, ecs_entity_t *entities)
+{
+    return ecs_world_reserve_entity_ids(cs, count, entities);
+}
+
+ecs_err_t ecs_flush_entities()
+{
+    return ecs_world_flush_entities(cs);
+}
+
+ecs_err_t ecs_delete_entity(ecs_entity_t entity)
+{
+    return ecs_world_delete_entity(cs, entity);
+}
+
+ecs_err_t ecs_add_component_by_name(ecs_entity_t entity, const char *name, void *default_value)
+{
+    return ecs_world_add_component_by_name(cs, entity, name, default_value);
+}
+
+ecs_err_t ecs_emplace_component_by_name(ecs_entity_t entity, const char *name, void **dest)
+{
+    return ecs_world_emplace_component_by_name(cs, entity, name, dest);
+}
+
+ecs_err_t ecs_set_component_hooks_by_name(const char *name, const ecs_component_hooks_t *hooks)
+{
+    return ecs_world_set_component_hooks_by_name(cs, name, hooks);
+}
+
+ecs_err_t ecs_remove_component_by_name(ecs_entity_t entity, const char *name)
+{
+    return ecs_world_remove_component_by_name(cs, entity, name);
+}
+
+ecs_err_t ecs_get_component_by_name(ecs_entity_t entity, const char *name, void **dest)
+{
+    return ecs_world_get_component_by_name(cs, entity, name, dest);
+}
+
+ecs_err_t ecs_set_component_by_name(ecs_entity_t entity, const char *name, const void *value)
+{
+    return ecs_world_set_component_by_name(cs, entity, name, value);
+}
+
+ecs_err_t ecs_get_previous_component_by_name(ecs_entity_t entity, const char *name, const void **dest)
+{
+    return ecs_world_get_previous_component_by_name(cs, entity, name, dest);
+}
+
+ecs_err_t ecs_get_components_by_name(const char *name, void **data, ecs_entity_t **entities, int *count)
+{
+    return ecs_world_get_components_by_name(cs, name, data, entities, count);
+}
+
+ecs_err_t ecs_get_component_id(const char *name, int *id)
+{
+    return ecs_world_get_component_id(cs, name, id);
+}
+
+ecs_err_t ecs_get_component_by_id(ecs_entity_t entity, int id, void **dest)
+{
+    return ecs_world_get_component_by_id(cs, entity, id, dest);
+}
+
+ecs_err_t ecs_get_column(int id, ecs_column_t *column)
+{
+    return ecs_world_get_column(cs, id, column);
+}
+
+ecs_err_t ecs_gather_components(int id, const ecs_entity_t *entities, int count, void *dst, size_t stride)
+{
+    return ecs_world_gather_components(cs, id, entities, count, dst, stride);
+}
+
+ecs_err_t ecs_scatter_components(int id, const ecs_entity_t *entities, int count, const void *src, size_t stride)
+{
+    return ecs_world_scatter_components(cs, id, entities, count, src, stride);
+}
+
+ecs_err_t ecs_sort_component_by_name(const char *name, ecs_sort_key_t key_fn, bool incremental)
+{
+    return ecs_world_sort_component_by_name(cs, name, key_fn, incremental);
+}
+
+ecs_err_t ecs_get_previous_components_by_name(const char *name, const void **data, const ecs_entity_t **entities, int *count, uint32_t *generation)
+{
+    return ecs_world_get_previous_components_by_name(cs, name, data, entities, count, generation);
+}
+
+ecs_err_t ecs_get_component_generation_by_name(const char *name, uint32_t *generation)
+{
+    return ecs_world_get_component_generation_by_name(cs, name, generation);
+}
+
+ecs_err_t ecs_set_component_double_buffered_by_name(const char *name, bool enabled)
+{
+    return ecs_world_set_component_double_buffered_by_name(cs, name, enabled);
+}
+
+bool ecs_entity_has_component_by_name(ecs_entity_t entity, const char *name)
+{
+    return ecs_world_entity_has_component_by_name(cs, entity, name);
+}
+
+ecs_err_t ecs_register_buffer_by_name(const char *name, size_t element_size, int inline_capacity)
+{
+    return ecs_world_register_buffer_by_name(cs, name, element_size, inline_capacity);
+}
+
+ecs_err_t ecs_buffer_append_by_name(ecs_entity_t entity, const char *name, const void *values, int count)
+{
+    return ecs_world_buffer_append_by_name(cs, entity, name, values, count);
+}
+
+ecs_err_t ecs_buffer_clear_by_name(ecs_entity_t entity, const char *name)
+{
+    return ecs_world_buffer_clear_by_name(cs, entity, name);
+}
+
+ecs_err_t ecs_buffer_get_by_name(ecs_entity_t entity, const char *name, void **data, int *count)
+{
+    return ecs_world_buffer_get_by_name(cs, entity, name, data, count);
+}
+
+ecs_err_t ecs_move_entities(ecs_scene_t src, ecs_scene_t dst, const ecs_entity_t *entities, int count, ecs_entity_t *out)
+{
+    ecs_world_t *src_world, *dst_world;
+    if (ecs_get_scene_world(src, &src_world) != ECS_OK || ecs_get_scene_world(dst, &dst_world) != ECS_OK)
+    {
+        return ECS_ERR_NULL;
+    }
+
+    return ecs_world_move_entities(src_world, dst_world, entities, count, out);
+}
+
+ecs_err_t ecs_set_entity_enabled(ecs_entity_t entity, bool enabled)
+{
+    return ecs_world_set_entity_enabled(cs, entity, enabled);
+}
+
+bool ecs_is_entity_enabled(ecs_entity_t entity)
+{
+    return ecs_world_is_entity_enabled(cs, entity);
+}
+
+ecs_err_t ecs_set_component_enabled_by_name(ecs_entity_t entity, const char *name, bool enabled)
+{
+    return ecs_world_set_component_enabled_by_name(cs, entity, name, enabled);
+}
+
+bool ecs_is_component_enabled_by_name(ecs_entity_t entity, const char *name)
+{
+    return ecs_world_is_component_enabled_by_name(cs, entity, name);
+}
+
+ecs_err_t ecs_create_prefab(ecs_prefab_t *prefab, ecs_entity_t entity)
+{
+    return ecs_world_create_prefab(cs, prefab, entity);
+}
+
+ecs_err_t ecs_free_prefab(ecs_prefab_t prefab)
+{
+    return ecs_world_free_prefab(cs, prefab);
+}
+
+ecs_err_t ecs_instantiate(ecs_prefab_t prefab, int count, ecs_entity_t *entities)
+{
+    return ecs_world_instantiate(cs, prefab, count, entities);
+}
+
+ecs_err_t ecs_set_resource_by_name(const char *name, void *value)
+{
+    return ecs_world_set_resource_by_name(cs, name, value);
+}
+
+ecs_err_t ecs_get_resource_by_name(const char *name, void **dest)
+{
+    return ecs_world_get_resource_by_name(cs, name, dest);
+}
+
+ecs_err_t ecs_register_event_channel_by_name(const char *name, int capacity)
+{
+    return ecs_world_register_event_channel_by_name(cs, name, capacity);
+}
+
+ecs_err_t ecs_publish_events_by_name(const char *name, const void *events, int count)
+{
+    return ecs_world_publish_events_by_name(cs, name, events, count);
+}
+
+ecs_err_t ecs_consume_events_by_name(const char *name, void *dest, int max, int *count)
+{
+    return ecs_world_consume_events_by_name(cs, name, dest, max, count);
+}
+
+ecs_err_t ecs_create_index_by_name(ecs_index_t *index, const char *name, size_t offset, size_t size, ecs_key_type_t key_type, ecs_index_kind_t kind)
+{
+    return ecs_world_create_index_by_name(cs, index, name, offset, size, key_type, kind);
+}
+
+ecs_err_t ecs_free_index(ecs_index_t index)
+{
+    return ecs_world_free_index(cs, index);
+}
+
+ecs_err_t ecs_reindex_component_by_name(const char *name)
+{
+    return ecs_world_reindex_component_by_name(cs, name);
+}
+
+ecs_err_t ecs_index_find(ecs_index_t index, const void *key, ecs_entity_t **entities, int *count)
+{
+    return ecs_world_index_find(cs, index, key, entities, count);
+}
+
+ecs_err_t ecs_index_range(ecs_index_t index, const void *min, const void *max, ecs_entity_t **entities, int *count)
+{
+    return ecs_world_index_range(cs, index, min, max, entities, count);
+}
+
+ecs_err_t ecs_fork_scene()
+{
+    return ecs_world_fork(cs);
+}
+
+ecs_err_t ecs_restore_scene()
+{
+    return ecs_world_restore_fork(cs);
+}
+
+ecs_err_t ecs_commit_scene()
+{
+    return ecs_world_commit_fork(cs);
+}
+
+ecs_err_t ecs_scene_checksum(uint64_t *checksum)
+{
+    return ecs_world_checksum(cs, checksum);
+}
+
+ecs_err_t ecs_set_snapshot_capacity(int frames)
+{
+    return ecs_world_set_snapshot_capacity(cs, frames);
+}
+
+ecs_err_t ecs_take_snapshot(uint64_t *frame)
+{
+    return ecs_world_take_snapshot(cs, frame);
+}
+
+ecs_err_t ecs_restore_snapshot(uint64_t frame)
+{
+    return ecs_world_restore_snapshot(cs, frame);
+}
+
+ecs_err_t ecs_get_snapshot_range(uint64_t *first, uint64_t *last, size_t *bytes)
+{
+    return ecs_world_get_snapshot_range(cs, first, last, bytes);
+}
+
+ecs_err_t ecs_set_parent(ecs_entity_t entity, ecs_entity_t parent)
+{
+    return ecs_world_set_parent(cs, entity, parent);
+}
+
+ecs_err_t ecs_get_parent(ecs_entity_t entity, ecs_entity_t *parent)
+{
+    return ecs_world_get_parent(cs, entity, parent);
+}
+
+ecs_err_t ecs_get_descendants(ecs_entity_t entity, const ecs_entity_t **descendants, int *count)
+{
+    return ecs_world_get_descendants(cs, entity, descendants, count);
+}
+
+ecs_err_t ecs_get_hierarchy(const ecs_entity_t **entities, const int **parents, int *count)
+{
+    return ecs_world_get_hierarchy(cs, entities, parents, count);
+}
+
+ecs_err_t ecs_create_spatial_index_by_name(ecs_spatial_index_t *index, const char *name, size_t offset, int dims, float cell_size)
+{
+    return ecs_world_create_spatial_index_by_name(cs, index, name, offset, dims, cell_size);
+}
+
+ecs_err_t ecs_free_spatial_index(ecs_spatial_index_t index)
+{
+    return ecs_world_free_spatial_index(cs, index);
+}
+
+ecs_err_t ecs_rebuild_spatial_index(ecs_spatial_index_t index, int threads)
+{
+    return ecs_world_rebuild_spatial_index(cs, index, threads);
+}
+
+ecs_err_t ecs_spatial_query_radius(ecs_spatial_index_t index, const float *center, float radius, ecs_entity_t **entities, int *count)
+{
+    return ecs_world_spatial_query_radius(cs, index, center, radius, entities, count);
+}
+
+ecs_err_t ecs_spatial_query_aabb(ecs_spatial_index_t index, const float *min, const float *max, ecs_entity_t **entities, int *count)
+{
+    return ecs_world_spatial_query_aabb(cs, index, min, max, entities, count);
+}
+
+ecs_err_t ecs_create_query(ecs_query_t *query, ecs_signature_t with, ecs_signature_t without, ecs_signature_t optional)
+{
+    return ecs_world_create_query(cs, query, with, without, optional);
+}
+
+ecs_err_t ecs_free_query(ecs_query_t query)
+{
+    return ecs_world_free_query(cs, query);
+}
+
+ecs_err_t ecs_query_entities(ecs_query_t query, ecs_entity_t **entities, int *count)
+{
+    return ecs_world_query_entities(cs, query, entities, count);
+}
+
+ecs_err_t ecs_register_query_system(ecs_system_t system, ecs_query_t query, ecs_system_event_t event)
+{
+    return ecs_world_register_query_system(cs, system, query, event);
+}
+
+ecs_err_t ecs_register_system(ecs_system_t system, ecs_signature_t signature, ecs_system_event_t event)
+{
+    return ecs_world_register_system(cs, system, signature, event);
+}
+
+ecs_err_t ecs_register_scheduled_system(ecs_system_t system, ecs_query_t query, ecs_system_event_t event, const ecs_system_config_t *config)
+{
+    return ecs_world_register_scheduled_system(cs, system, query, event, config);
+}
+
+ecs_err_t ecs_unregister_system(ecs_system_t system)
+{
+    return ecs_world_unregister_system(cs, system);
+}
+
+ecs_err_t ecs_set_system_parameters(ecs_system_t system, int argc, void *argv[])
+{
+    return ecs_world_set_system_parameters(cs, system, argc, argv);
+}
+
+ecs_err_t ecs_set_system_resources(ecs_system_t system, ecs_signature_t read, ecs_signature_t write)
+{
+    return ecs_world_set_system_resources(cs, system, read, write);
+}
+
+ecs_err_t ecs_set_system_events(ecs_system_t system, ecs_signature_t publish, ecs_signature_t consume)
+{
+    return ecs_world_set_system_events(cs, system, publish, consume);
+}
+
+ecs_err_t ecs_call_system(ecs_system_t system)
+{
+    return ecs_world_call_system(cs, system);
+}
+
+ecs_err_t ecs_set_system_fusion(int chunk_size)
+{
+    return ecs_world_set_system_fusion(cs, chunk_size);
+}
+
+ecs_err_t ecs_listen_systems(ecs_system_event_t event)
+{
+    return ecs_world_listen_systems(cs, event);
+}
+
+void *ecs_scratch_alloc(size_t size)
+{
+    return ecs_world_scratch_alloc(cs, size);
+}
+
+ecs_err_t ecs_reserve_scratch(size_t size)
+{
+    return ecs_world_reserve_scratch(cs, size);
+}
+
+ecs_err_t ecs_get_scratch_stats(ecs_scratch_stats_t *stats)
+{
+    return ecs_world_get_scratch_stats(cs, stats);
+}
+
+ecs_err_t ecs_set_numa_mode(bool enabled)
+{
+    return ecs_world_set_numa_mode(cs, enabled);
+}
+
+ecs_err_t ecs_parallel_for(int id, int workers, ecs_parallel_fn_t fn, void *ctx)
+{
+    return ecs_world_parallel_for(cs, id, workers, fn, ctx);
+}
+
+ecs_err_t ecs_get_numa_occupancy(int id, size_t *bytes, int max_nodes, int *node_count)
+{
+    return ecs_world_get_numa_occupancy(cs, id, bytes, max_nodes, node_count);
+}
+
+ecs_err_t ecs_compact(int budget_us)
+{
+    return ecs_world_compact(cs, budget_us);
+}
+
+ecs_err_t ecs_reserve_entities(ecs_entity_t max_entities)
+{
+    return ecs_world_reserve_entities(cs, max_entities);
+}
+
+ecs_err_t ecs_shrink_entities()
+{
+    return ecs_world_shrink_entities(cs);
+}
+
+ecs_err_t ecs_create_signature_by_names(ecs_signature_t *signature, const char *names)
+{
+    return ecs_world_create_signature_by_names(cs, signature, names);
+}
+
+ecs_err_t ecs_get_system_status(ecs_system_t system, ecs_err_t *ret)
+{
+    return ecs_world_get_system_status(cs, system, ret);
+}
+
+ecs_err_t ecs_get_system_stats(ecs_system_t system, ecs_system_stats_t *stats)
+{
+    return ecs_world_get_system_stats(cs, system, stats);
 }
@@ -0,0 +1,92 @@
+/**
+ * @file        : block_pool
+ * @brief       : Size-classed blocks carved from a growing arena
+ */
+
+#ifndef BLOCK_POOL_H
+#define BLOCK_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "../src/utils/vector.h"
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------------
+#define BLOCK_POOL_CLASSES 32
+#define BLOCK_POOL_ALIGN 16
+
+//------------------------------------------------------------------------------
+// Typedefs and Enums
+//------------------------------------------------------------------------------
+// Blocks carved from a single growing arena, with a free list per size
+// class. Blocks are referred to by offset as the arena moves when it grows.
+// Every block of a class has the size given at its first allocation.
+typedef struct
+{
+    vector_t arena;
+    vector_t free_blocks[BLOCK_POOL_CLASSES];
+} block_pool_t;
+
+//------------------------------------------------------------------------------
+// Inline Functions
+//------------------------------------------------------------------------------
+static inline void block_pool_init(block_pool_t *pool)
+{
+    vector_init(&pool->arena, 1, 0);
+    for (int i = 0; i < BLOCK_POOL_CLASSES; ++i)
+    {
+        vector_init(&pool->free_blocks[i], sizeof(size_t), 0);
+    }
+}
+
+static inline int block_pool_alloc(block_pool_t *pool, int size_class, size_t size, size_t *offset)
+{
+    vector_t *free_blocks = &pool->free_blocks[size_class];
+    if (free_blocks->size > 0)
+    {
+        *offset = ((size_t *)free_blocks->data)[--free_blocks->size];
+        return 0;
+    }
+
+    size_t old_size = pool->arena.size;
+    size = (size + BLOCK_POOL_ALIGN - 1) & ~(size_t)(BLOCK_POOL_ALIGN - 1);
+    if (vector_resize(&pool->arena, old_size + size))
+    {
+        return 1;
+    }
+    *offset = old_size;
+
+    return 0;
+}
+
+static inline int block_pool_free(block_pool_t *pool, int size_class, size_t offset)
+{
+    return vector_push_back(&pool->free_blocks[size_class], &offset);
+}
+
+static inline void *block_pool_get(block_pool_t *pool, size_t offset)
+{
+    return (char *)pool->arena.data + offset;
+}
+
+static inline void block_pool_destroy(block_pool_t *pool)
+{
+    vector_free(&pool->arena);
+    for (int i = 0; i < BLOCK_POOL_CLASSES; ++i)
+    {
+        vector_free(&pool->free_blocks[i]);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* BLOCK_POOL_H */
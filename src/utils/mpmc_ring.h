@@ -0,0 +1,185 @@
+/**
+ * @file        : mpmc_ring
+ * @brief       : Bounded lock-free multi-producer multi-consumer ring
+ */
+
+#ifndef MPMC_RING_H
+#define MPMC_RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+// Typedefs and Enums
+//------------------------------------------------------------------------------
+// Bounded multi-producer multi-consumer queue. Every slot carries a sequence
+// number telling whether it is free for the producer at that position or
+// filled for the consumer, so producers and consumers only synchronise on
+// the slots they claim.
+typedef struct
+{
+    void *data;
+    uint32_t *sequences;
+    size_t element_size;
+    uint32_t capacity;
+    uint32_t mask;
+
+    uint32_t head;
+    uint32_t tail;
+} mpmc_ring_t;
+
+//------------------------------------------------------------------------------
+// Inline Functions
+//------------------------------------------------------------------------------
+static inline void mpmc_ring_clear(mpmc_ring_t *ring)
+{
+    for (uint32_t i = 0; i < ring->capacity; ++i)
+    {
+        ring->sequences[i] = i;
+    }
+    __atomic_store_n(&ring->head, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->tail, 0, __ATOMIC_RELEASE);
+}
+
+static inline int mpmc_ring_init(mpmc_ring_t *ring, size_t element_size, uint32_t capacity)
+{
+    // Capacity is rounded up to a power of two
+    uint32_t n = 1;
+    while (n < capacity)
+    {
+        n *= 2;
+    }
+
+    ring->element_size = element_size;
+    ring->capacity = n;
+    ring->mask = n - 1;
+    ring->data = malloc(n * element_size);
+    ring->sequences = malloc(n * sizeof(uint32_t));
+    if (ring->data == NULL || ring->sequences == NULL)
+    {
+        free(ring->data);
+        free(ring->sequences);
+        ring->data = NULL;
+        ring->sequences = NULL;
+        return 1;
+    }
+    mpmc_ring_clear(ring);
+
+    return 0;
+}
+
+// Claims up to `count` consecutive slots starting at the returned position,
+// `ready` is the sequence a slot has when it can be claimed at position pos
+static inline int mpmc_ring_claim(mpmc_ring_t *ring, uint32_t *cursor, int count, uint32_t ready_offset, uint32_t *first)
+{
+    uint32_t pos = __atomic_load_n(cursor, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        int n = 0;
+        while (n < count)
+        {
+            uint32_t seq = __atomic_load_n(&ring->sequences[(pos + n) & ring->mask], __ATOMIC_ACQUIRE);
+            if ((int32_t)(seq - (pos + n + ready_offset)) != 0)
+            {
+                break;
+            }
+            ++n;
+        }
+
+        if (n == 0)
+        {
+            // Retry if another thread moved the cursor meanwhile
+            uint32_t npos = __atomic_load_n(cursor, __ATOMIC_RELAXED);
+            if (npos == pos)
+            {
+                return 0;
+            }
+            pos = npos;
+            continue;
+        }
+
+        if (__atomic_compare_exchange_n(cursor, &pos, pos + n, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            *first = pos;
+            return n;
+        }
+    }
+}
+
+// Returns the number of elements pushed, less than count when full
+static inline int mpmc_ring_push(mpmc_ring_t *ring, const void *elements, int count)
+{
+    int pushed = 0;
+    while (pushed < count)
+    {
+        uint32_t first;
+        int n = mpmc_ring_claim(ring, &ring->head, count - pushed, 0, &first);
+        if (n == 0)
+        {
+            break;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            uint32_t pos = first + i;
+            memcpy((char *)ring->data + (pos & ring->mask) * ring->element_size,
+                    (const char *)elements + (pushed + i) * ring->element_size, ring->element_size);
+            __atomic_store_n(&ring->sequences[pos & ring->mask], pos + 1, __ATOMIC_RELEASE);
+        }
+        pushed += n;
+    }
+
+    return pushed;
+}
+
+// Returns the number of elements popped, less than max when empty
+static inline int mpmc_ring_pop(mpmc_ring_t *ring, void *elements, int max)
+{
+    int popped = 0;
+    while (popped < max)
+    {
+        uint32_t first;
+        int n = mpmc_ring_claim(ring, &ring->tail, max - popped, 1, &first);
+        if (n == 0)
+        {
+            break;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            uint32_t pos = first + i;
+            memcpy((char *)elements + (popped + i) * ring->element_size,
+                    (char *)ring->data + (pos & ring->mask) * ring->element_size, ring->element_size);
+            __atomic_store_n(&ring->sequences[pos & ring->mask], pos + ring->capacity, __ATOMIC_RELEASE);
+        }
+        popped += n;
+    }
+
+    return popped;
+}
+
+static inline void mpmc_ring_free(mpmc_ring_t *ring)
+{
+    free(ring->data);
+    free(ring->sequences);
+    ring->data = NULL;
+    ring->sequences = NULL;
+    ring->capacity = 0;
+}
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* MPMC_RING_H */
@@ -0,0 +1,208 @@
+/**
+ * @file        : numa_topology
+ * @brief       : NUMA nodes from sysfs, thread pinning and page queries
+ */
+
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+//------------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------------
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 1024
+#define NUMA_PAGE_BATCH 256
+
+//------------------------------------------------------------------------------
+// Typedefs and Enums
+//------------------------------------------------------------------------------
+// Nodes with CPUs as listed by sysfs, the CPUs of node n being
+// cpus[cpu_starts[n]] to cpus[cpu_starts[n + 1]]. Machines without sysfs
+// have a single node without CPUs, which threads are never pinned to.
+typedef struct
+{
+    int node_count;
+    int node_ids[NUMA_MAX_NODES];
+    int cpu_starts[NUMA_MAX_NODES + 1];
+    int cpus[NUMA_MAX_CPUS];
+} numa_topology_t;
+
+//------------------------------------------------------------------------------
+// Inline Functions
+//------------------------------------------------------------------------------
+// Parses a sysfs list such as "0-3,8-11", returns the number of values
+static inline int numa_parse_list(const char *list, int *values, int max)
+{
+    int count = 0;
+    while (*list >= '0' && *list <= '9')
+    {
+        char *end;
+        long first = strtol(list, &end, 10), last = first;
+        if (*end == '-')
+        {
+            last = strtol(end + 1, &end, 10);
+        }
+        for (long v = first; v <= last && count < max; ++v)
+        {
+            values[count++] = (int)v;
+        }
+        list = *end == ',' ? end + 1 : end;
+    }
+
+    return count;
+}
+
+static inline int numa_read_list(const char *path, int *values, int max)
+{
+    char line[4096];
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return 0;
+    }
+    int count = fgets(line, sizeof(line), file) ? numa_parse_list(line, values, max) : 0;
+    fclose(file);
+
+    return count;
+}
+
+static inline void numa_topology_detect(numa_topology_t *topology)
+{
+    int nodes[NUMA_MAX_NODES];
+    int node_count = numa_read_list("/sys/devices/system/node/online", nodes, NUMA_MAX_NODES);
+
+    topology->node_count = 0;
+    topology->cpu_starts[0] = 0;
+    for (int i = 0; i < node_count; ++i)
+    {
+        char path[64];
+        int n = topology->node_count, first = topology->cpu_starts[n];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nodes[i]);
+        int cpus = numa_read_list(path, topology->cpus + first, NUMA_MAX_CPUS - first);
+
+        // Memory only nodes run no worker
+        if (cpus > 0)
+        {
+            topology->node_ids[n] = nodes[i];
+            topology->cpu_starts[n + 1] = first + cpus;
+            ++topology->node_count;
+        }
+    }
+
+    if (topology->node_count == 0)
+    {
+        topology->node_count = 1;
+        topology->node_ids[0] = 0;
+        topology->cpu_starts[1] = 0;
+    }
+}
+
+static inline int numa_node_index(const numa_topology_t *topology, int node_id)
+{
+    for (int n = 0; n < topology->node_count; ++n)
+    {
+        if (topology->node_ids[n] == node_id)
+        {
+            return n;
+        }
+    }
+
+    return -1;
+}
+
+// Restricts the calling thread to the CPUs of a node
+static inline int numa_pin_thread(const numa_topology_t *topology, int node)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = topology->cpu_starts[node]; i < topology->cpu_starts[node + 1]; ++i)
+    {
+        CPU_SET(topology->cpus[i], &set);
+    }
+
+    return CPU_COUNT(&set) > 0 ? pthread_setaffinity_np(pthread_self(), sizeof(set), &set) : 0;
+#else
+    (void)topology;
+    (void)node;
+    return 0;
+#endif
+}
+
+// Adds the resident bytes of [data, data + size) to the count of their
+// node. Fails, leaving the counts untouched, when the kernel cannot tell
+// where pages are.
+static inline int numa_count_pages(const numa_topology_t *topology, const void *data, size_t size, size_t *bytes)
+{
+#if defined(__linux__) && defined(SYS_move_pages)
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t counts[NUMA_MAX_NODES] = { 0 };
+    uintptr_t begin = (uintptr_t)data, end = begin + size;
+    uintptr_t page = begin & ~(uintptr_t)(page_size - 1);
+    while (page < end)
+    {
+        void *pages[NUMA_PAGE_BATCH];
+        int status[NUMA_PAGE_BATCH];
+        int count = 0;
+        for (; count < NUMA_PAGE_BATCH && page + count * page_size < end; ++count)
+        {
+            pages[count] = (void *)(page + count * page_size);
+        }
+
+        // A positive result is a partial failure, the pages left out
+        // report a negative status like those not yet touched
+        if (syscall(SYS_move_pages, 0, (unsigned long)count, pages, NULL, status, 0) < 0)
+        {
+            return 1;
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            uintptr_t first = (uintptr_t)pages[i] > begin ? (uintptr_t)pages[i] : begin;
+            uintptr_t last = (uintptr_t)pages[i] + page_size < end ? (uintptr_t)pages[i] + page_size : end;
+            int node = status[i] >= 0 ? numa_node_index(topology, status[i]) : -1;
+            if (node >= 0)
+            {
+                counts[node] += last - first;
+            }
+        }
+        page += count * page_size;
+    }
+
+    for (int n = 0; n < topology->node_count; ++n)
+    {
+        bytes[n] += counts[n];
+    }
+
+    return 0;
+#else
+    (void)topology;
+    (void)data;
+    (void)size;
+    (void)bytes;
+    return 1;
+#endif
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* NUMA_TOPOLOGY_H */
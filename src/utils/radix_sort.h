@@ -0,0 +1,108 @@
+/**
+ * @file        : radix_sort
+ * @brief       : Radix and insertion sorts of 64-bit keys
+ */
+
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <stdint.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------
+// Inline Functions
+//------------------------------------------------------------------------------
+// Stable LSD radix sort of keys and their values, 8 bits per pass. Passes
+// where every key has the same byte are skipped. The sorted data ends up
+// in keys and values, tmp arrays hold count elements.
+static inline void radix_sort_u64(uint64_t *keys, uint32_t *values, int count, uint64_t *tmp_keys, uint32_t *tmp_values)
+{
+    int histograms[8][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (int i = 0; i < count; ++i)
+    {
+        for (int pass = 0; pass < 8; ++pass)
+        {
+            ++histograms[pass][(keys[i] >> (pass * 8)) & 0xff];
+        }
+    }
+
+    uint64_t *src_keys = keys, *dst_keys = tmp_keys;
+    uint32_t *src_values = values, *dst_values = tmp_values;
+    for (int pass = 0; pass < 8; ++pass)
+    {
+        int *histogram = histograms[pass];
+        if (count == 0 || histogram[(keys[0] >> (pass * 8)) & 0xff] == count)
+        {
+            continue;
+        }
+
+        int offset = 0;
+        for (int b = 0; b < 256; ++b)
+        {
+            int n = histogram[b];
+            histogram[b] = offset;
+            offset += n;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            int pos = histogram[(src_keys[i] >> (pass * 8)) & 0xff]++;
+            dst_keys[pos] = src_keys[i];
+            dst_values[pos] = src_values[i];
+        }
+
+        uint64_t *k = src_keys; src_keys = dst_keys; dst_keys = k;
+        uint32_t *v = src_values; src_values = dst_values; dst_values = v;
+    }
+
+    if (src_keys != keys)
+    {
+        memcpy(keys, src_keys, count * sizeof(uint64_t));
+        memcpy(values, src_values, count * sizeof(uint32_t));
+    }
+}
+
+// Insertion sort for nearly sorted data, gives up once `max_moves` elements
+// were shifted and returns 1, the data is left partially sorted.
+static inline int insertion_sort_u64(uint64_t *keys, uint32_t *values, int count, long max_moves)
+{
+    long moves = 0;
+    for (int i = 1; i < count; ++i)
+    {
+        uint64_t key = keys[i];
+        uint32_t value = values[i];
+        int j = i;
+        while (j > 0 && keys[j - 1] > key)
+        {
+            keys[j] = keys[j - 1];
+            values[j] = values[j - 1];
+            --j;
+        }
+        keys[j] = key;
+        values[j] = value;
+
+        moves += i - j;
+        if (moves > max_moves)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* RADIX_SORT_H */
@@ -0,0 +1,150 @@
+/**
+ * @file        : scratch_arena
+ * @brief       : Resettable bump allocator
+ */
+
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <stddef.h>
+#include <stdlib.h>
+
+//------------------------------------------------------------------------------
+// Macros
+//------------------------------------------------------------------------------
+#define SCRATCH_ARENA_ALIGN 16
+#define SCRATCH_ARENA_MIN_BLOCK (64 * 1024)
+
+//------------------------------------------------------------------------------
+// Typedefs and Enums
+//------------------------------------------------------------------------------
+typedef struct scratch_block
+{
+    struct scratch_block *next;
+    size_t size;
+    size_t used;
+} scratch_block_t;
+
+// Bump allocator over a chain of blocks, the current block first. Pointers
+// stay valid until the next reset, which merges the chain into one block
+// large enough for everything allocated since the previous reset.
+typedef struct
+{
+    scratch_block_t *blocks;
+    size_t used;
+    size_t capacity;
+    size_t high_water;
+
+    // Counts resets and freed blocks, telling apart allocations made at the
+    // same place before and after
+    size_t resets;
+} scratch_arena_t;
+
+//------------------------------------------------------------------------------
+// Inline Functions
+//------------------------------------------------------------------------------
+static inline size_t scratch_arena_header_size()
+{
+    return (sizeof(scratch_block_t) + SCRATCH_ARENA_ALIGN - 1) & ~(size_t)(SCRATCH_ARENA_ALIGN - 1);
+}
+
+static inline void scratch_arena_init(scratch_arena_t *arena)
+{
+    *arena = (scratch_arena_t){ 0 };
+}
+
+static inline int scratch_arena_add_block(scratch_arena_t *arena, size_t size)
+{
+    scratch_block_t *block = malloc(scratch_arena_header_size() + size);
+    if (block == NULL)
+    {
+        return 1;
+    }
+
+    *block = (scratch_block_t){ .next=arena->blocks, .size=size };
+    arena->blocks = block;
+    arena->capacity += size;
+
+    return 0;
+}
+
+static inline void *scratch_arena_alloc(scratch_arena_t *arena, size_t size)
+{
+    size = (size + SCRATCH_ARENA_ALIGN - 1) & ~(size_t)(SCRATCH_ARENA_ALIGN - 1);
+    scratch_block_t *block = arena->blocks;
+    if (block == NULL || block->size - block->used < size)
+    {
+        // Blocks at least double, the arena settles after a few resets
+        size_t block_size = block ? block->size * 2 : SCRATCH_ARENA_MIN_BLOCK;
+        if (scratch_arena_add_block(arena, block_size > size ? block_size : size))
+        {
+            return NULL;
+        }
+        block = arena->blocks;
+    }
+
+    void *ptr = (char *)block + scratch_arena_header_size() + block->used;
+    block->used += size;
+    arena->used += size;
+    if (arena->used > arena->high_water)
+    {
+        arena->high_water = arena->used;
+    }
+
+    return ptr;
+}
+
+// Gives back the latest allocation, `size` being the growth of `used` it
+// caused
+static inline void scratch_arena_pop(scratch_arena_t *arena, size_t size)
+{
+    arena->blocks->used -= size;
+    arena->used -= size;
+}
+
+static inline void scratch_arena_free_blocks(scratch_arena_t *arena)
+{
+    while (arena->blocks)
+    {
+        scratch_block_t *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    arena->capacity = 0;
+    ++arena->resets;
+}
+
+static inline void scratch_arena_reset(scratch_arena_t *arena)
+{
+    if (arena->blocks && arena->blocks->next)
+    {
+        size_t capacity = arena->capacity;
+        scratch_arena_free_blocks(arena);
+        scratch_arena_add_block(arena, capacity);
+    }
+    if (arena->blocks)
+    {
+        arena->blocks->used = 0;
+    }
+    arena->used = 0;
+    ++arena->resets;
+}
+
+static inline void scratch_arena_destroy(scratch_arena_t *arena)
+{
+    scratch_arena_free_blocks(arena);
+    arena->used = 0;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* SCRATCH_ARENA_H */
@@ -0,0 +1,111 @@
+/**
+ * @file        : sparse_map
+ * @brief       : Entity keyed map over a plain array
+ */
+
+#ifndef SPARSE_MAP_H
+#define SPARSE_MAP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "../src/utils/vector.h"
+
+//------------------------------------------------------------------------------
+// Typedefs and Enums
+//------------------------------------------------------------------------------
+// Maps small non-negative integer keys (entity ids) to non-negative values
+// through a plain array, -1 marking an absent key.
+typedef struct sparse_map
+{
+    vector_t values;
+} sparse_map_t;
+
+//------------------------------------------------------------------------------
+// Inline Functions
+//------------------------------------------------------------------------------
+static inline void sparse_map_init(sparse_map_t *map)
+{
+    vector_init(&map->values, sizeof(int), 0);
+}
+
+static inline int sparse_map_reserve(sparse_map_t *map, int max_key)
+{
+    int old_size = map->values.size;
+    if (max_key < old_size)
+    {
+        return 0;
+    }
+
+    if (vector_resize(&map->values, max_key + 1))
+    {
+        return 1;
+    }
+    memset((int *)map->values.data + old_size, 0xff, (map->values.size - old_size) * sizeof(int));
+
+    return 0;
+}
+
+static inline int sparse_map_insert(sparse_map_t *map, int key, int value)
+{
+    if (key < 0 || sparse_map_reserve(map, key))
+    {
+        return 1;
+    }
+    ((int *)map->values.data)[key] = value;
+
+    return 0;
+}
+
+static inline int sparse_map_get(sparse_map_t *map, int key, int *value)
+{
+    if (key < 0 || key >= map->values.size)
+    {
+        return 0;
+    }
+
+    int v = ((int *)map->values.data)[key];
+    if (v < 0)
+    {
+        return 0;
+    }
+    if (value)
+    {
+        *value = v;
+    }
+
+    return 1;
+}
+
+static inline void sparse_map_remove(sparse_map_t *map, int key)
+{
+    if (key >= 0 && key < map->values.size)
+    {
+        ((int *)map->values.data)[key] = -1;
+    }
+}
+
+static inline void sparse_map_clear(sparse_map_t *map)
+{
+    if (map->values.size > 0)
+    {
+        memset(map->values.data, 0xff, map->values.size * sizeof(int));
+    }
+}
+
+static inline void sparse_map_destroy(sparse_map_t *map)
+{
+    vector_free(&map->values);
+}
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* SPARSE_MAP_H */
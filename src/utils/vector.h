@@ -77,6 +77,38 @@ static inline int vector_reserve(vector_t *vec, size_t additional_capacity)
     return 0;
 }
 
+static inline int vector_resize(vector_t *vec, int size)
+{
+    if (size > vec->capacity)
+    {
+        size_t new_capacity = vec->capacity ? vec->capacity : 1;
+        while (new_capacity < size)
+        {
+            new_capacity *= 2;
+        }
+        if (vector_reserve(vec, new_capacity - vec->capacity))
+        {
+            return 1;
+        }
+    }
+    vec->size = size;
+
+    return 0;
+}
+
+// Capacity for at least `size` elements, the size is left as is
+static inline int vector_reserve_size(vector_t *vec, int size)
+{
+    int old_size = vec->size;
+    if (vector_resize(vec, size))
+    {
+        return 1;
+    }
+    vec->size = old_size;
+
+    return 0;
+}
+
 static inline int vector_shrink(vector_t *vec)
 {
     if (vec->size == 0)
@@ -0,0 +1,209 @@
+/**
+ * @file        : worker_pool
+ * @brief       : Persistent threads running numbered workers of a job
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+//------------------------------------------------------------------------------
+// Typedefs and Enums
+//------------------------------------------------------------------------------
+// Runs worker `worker` of a job, `threaded` when on a thread of the pool
+// rather than on the caller
+typedef void (*worker_pool_fn_t)(void *arg, int worker, bool threaded);
+
+// Thread n runs worker n of every job reaching it. Threads are created on
+// demand and live until the pool is destroyed, sleeping between jobs.
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t idle;
+    pthread_t *threads;
+    int thread_count;
+    int thread_capacity;
+
+    // Current job, workers from `first` to `count` run on the threads
+    worker_pool_fn_t fn;
+    void *arg;
+    int first;
+    int count;
+    int pending;
+    uint64_t generation;
+    bool stop;
+} worker_pool_t;
+
+typedef struct
+{
+    worker_pool_t *pool;
+    int index;
+    uint64_t generation;
+} worker_pool_start_t;
+
+//------------------------------------------------------------------------------
+// Inline Functions
+//------------------------------------------------------------------------------
+static inline int worker_pool_init(worker_pool_t *pool)
+{
+    *pool = (worker_pool_t){ 0 };
+    if (pthread_mutex_init(&pool->lock, NULL))
+    {
+        return 1;
+    }
+    if (pthread_cond_init(&pool->wake, NULL))
+    {
+        pthread_mutex_destroy(&pool->lock);
+        return 1;
+    }
+    if (pthread_cond_init(&pool->idle, NULL))
+    {
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->lock);
+        return 1;
+    }
+
+    return 0;
+}
+
+static inline void *worker_pool_thread(void *arg)
+{
+    worker_pool_start_t start = *(worker_pool_start_t *)arg;
+    worker_pool_t *pool = start.pool;
+    free(arg);
+
+    pthread_mutex_lock(&pool->lock);
+    uint64_t seen = start.generation;
+    while (true)
+    {
+        while (!pool->stop && pool->generation == seen)
+        {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stop)
+        {
+            break;
+        }
+
+        seen = pool->generation;
+        if (start.index < pool->first || start.index >= pool->count)
+        {
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(pool->arg, start.index, true);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+        {
+            pthread_cond_signal(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+// Creates threads up to `count`, as many as possible when out of resources
+static inline void worker_pool_grow(worker_pool_t *pool, int count)
+{
+    if (count > pool->thread_capacity)
+    {
+        pthread_t *threads = realloc(pool->threads, count * sizeof(pthread_t));
+        if (threads == NULL)
+        {
+            return;
+        }
+        pool->threads = threads;
+        pool->thread_capacity = count;
+    }
+
+    while (pool->thread_count < count)
+    {
+        worker_pool_start_t *start = malloc(sizeof(worker_pool_start_t));
+        if (start == NULL)
+        {
+            return;
+        }
+
+        // Only jobs submitted after creation reach the thread
+        pthread_mutex_lock(&pool->lock);
+        *start = (worker_pool_start_t){ pool, pool->thread_count, pool->generation };
+        pthread_mutex_unlock(&pool->lock);
+        if (pthread_create(&pool->threads[pool->thread_count], NULL, worker_pool_thread, start))
+        {
+            free(start);
+            return;
+        }
+        ++pool->thread_count;
+    }
+}
+
+// Runs workers 0 to `count`, those below `first` and those without a thread
+// on the caller, and returns once all are done
+static inline void worker_pool_run(worker_pool_t *pool, int first, int count, worker_pool_fn_t fn, void *arg)
+{
+    worker_pool_grow(pool, count);
+
+    pthread_mutex_lock(&pool->lock);
+    int threaded = count < pool->thread_count ? count : pool->thread_count;
+    threaded = threaded > first ? threaded : first;
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->first = first;
+    pool->count = threaded;
+    pool->pending = threaded - first;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int w = 0; w < first; ++w)
+    {
+        fn(arg, w, false);
+    }
+    for (int w = threaded; w < count; ++w)
+    {
+        fn(arg, w, false);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+    {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static inline void worker_pool_destroy(worker_pool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; ++i)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    free(pool->threads);
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* WORKER_POOL_H */
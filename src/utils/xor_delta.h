@@ -0,0 +1,154 @@
+/**
+ * @file        : xor_delta
+ * @brief       : XOR byte deltas between two versions of a buffer
+ */
+
+#ifndef XOR_DELTA_H
+#define XOR_DELTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------------------
+// Includes
+//------------------------------------------------------------------------------
+#include "../src/utils/vector.h"
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Inline Functions
+//------------------------------------------------------------------------------
+// Byte deltas between two versions of a buffer: the new size, then runs of
+// unchanged bytes followed by literal XORed bytes, lengths as varints.
+// The previous version is zero extended to the new size.
+
+static inline int xor_delta_put_varint(vector_t *out, uint64_t value)
+{
+    uint8_t bytes[10];
+    int n = 0;
+    do
+    {
+        bytes[n++] = (value & 0x7f) | (value >= 0x80 ? 0x80 : 0);
+        value >>= 7;
+    } while (value);
+
+    int size = out->size;
+    if (vector_resize(out, size + n))
+    {
+        return 1;
+    }
+    memcpy((uint8_t *)out->data + size, bytes, n);
+
+    return 0;
+}
+
+static inline uint64_t xor_delta_get_varint(const uint8_t **in)
+{
+    uint64_t value = 0;
+    int shift = 0;
+    uint8_t byte;
+    do
+    {
+        byte = *(*in)++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return value;
+}
+
+static inline uint8_t xor_delta_byte(const uint8_t *prev, int prev_size, const uint8_t *cur, int i)
+{
+    return cur[i] ^ (i < prev_size ? prev[i] : 0);
+}
+
+// Appends the delta turning prev into cur to out
+static inline int xor_delta_encode(vector_t *out, const void *prev_data, int prev_size, const void *cur_data, int cur_size)
+{
+    const uint8_t *prev = prev_data, *cur = cur_data;
+    int common = prev_size < cur_size ? prev_size : cur_size;
+    if (xor_delta_put_varint(out, cur_size))
+    {
+        return 1;
+    }
+
+    int pos = 0;
+    while (pos < cur_size)
+    {
+        // Skip unchanged bytes, a word at a time where both versions exist
+        int start = pos;
+        while (pos + 8 <= common && memcmp(prev + pos, cur + pos, 8) == 0)
+        {
+            pos += 8;
+        }
+        while (pos < cur_size && xor_delta_byte(prev, prev_size, cur, pos) == 0)
+        {
+            ++pos;
+        }
+        int unchanged = pos - start;
+
+        // Literals end at the first run of 8 unchanged bytes
+        int literal = pos;
+        int zeros = 0;
+        while (pos < cur_size && zeros < 8)
+        {
+            zeros = xor_delta_byte(prev, prev_size, cur, pos) == 0 ? zeros + 1 : 0;
+            ++pos;
+        }
+        pos -= zeros;
+
+        int literal_size = pos - literal;
+        int size;
+        if (xor_delta_put_varint(out, unchanged) || xor_delta_put_varint(out, literal_size) ||
+                (size = out->size, vector_resize(out, size + literal_size)))
+        {
+            return 1;
+        }
+        for (int i = 0; i < literal_size; ++i)
+        {
+            ((uint8_t *)out->data)[size + i] = xor_delta_byte(prev, prev_size, cur, literal + i);
+        }
+    }
+
+    return 0;
+}
+
+// Applies a delta read from *in to buf, a vector of bytes
+static inline int xor_delta_apply(vector_t *buf, const uint8_t **in)
+{
+    int old_size = buf->size;
+    int size = xor_delta_get_varint(in);
+    if (vector_resize(buf, size))
+    {
+        return 1;
+    }
+    if (size > old_size)
+    {
+        memset((uint8_t *)buf->data + old_size, 0, size - old_size);
+    }
+
+    uint8_t *data = buf->data;
+    int pos = 0;
+    while (pos < size)
+    {
+        pos += xor_delta_get_varint(in);
+        int literal_size = xor_delta_get_varint(in);
+        for (int i = 0; i < literal_size; ++i)
+        {
+            data[pos + i] ^= (*in)[i];
+        }
+        *in += literal_size;
+        pos += literal_size;
+    }
+
+    return 0;
+}
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* XOR_DELTA_H */